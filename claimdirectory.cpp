@@ -0,0 +1,270 @@
+#include "claimdirectory.h"
+#include <QCoreApplication>
+#include <QFile>
+#include <QSaveFile>
+#include <QSysInfo>
+#include <QRegularExpression>
+#include <QSet>
+#include <QDateTime>
+#ifdef Q_OS_LINUX
+#include <sys/stat.h>
+#endif
+
+namespace nClaimDirectory {
+
+namespace {
+
+const QString leaseSuffix = ".lease";
+const QString lockSuffix = ".claim";
+/**
+ * @brief doneSuffix Follows the instance id in a done marker, so it never equals the content of an unfinished lock
+ */
+const QByteArray doneSuffix = "\ndone";
+
+QString resolveId(const ClaimOptions& options) {
+    QString id = options.instanceId;
+    if (id.isEmpty()) {
+        id = QSysInfo::machineHostName() + "_" + QString::number(QCoreApplication::applicationPid());
+    }
+    return id.replace(QRegularExpression("[^A-Za-z0-9_.-]"), "_");
+}
+
+}
+
+const QString ClaimDirectory::folderName = ".claims";
+
+ClaimDirectory::ClaimDirectory(const QDir& folder, const ClaimOptions& options) :
+    folder(folder), claims(folder.filePath(folderName)), leaseTimeout(options.leaseTimeout), heartbeatCounter(0),
+    isLeftoverChecked(false), isClosed(false), lastCollection(-1) {
+    instanceId = resolveId(options);
+    clock.start();
+}
+
+ClaimDirectory::~ClaimDirectory() {
+    close();
+}
+
+QString ClaimDirectory::identity(const QString& path) {
+#ifdef Q_OS_LINUX
+    // st_dev is left out: on NFS it differs between the clients, the inode number does not
+    struct stat status;
+    if (::stat(QFile::encodeName(path).constData(), &status) != 0) {
+        return QString();
+    }
+    return QString("%1-%2-%3.%4").arg(static_cast<qulonglong>(status.st_ino)).arg(static_cast<qlonglong>(status.st_size))
+        .arg(static_cast<qlonglong>(status.st_mtim.tv_sec)).arg(static_cast<qlonglong>(status.st_mtim.tv_nsec), 9, 10, QChar('0'));
+#else
+    const QFileInfo file(path);
+    if (!file.exists()) {
+        return QString();
+    }
+    return QString("%1-%2-%3").arg(file.size()).arg(file.lastModified().toMSecsSinceEpoch())
+        .arg(file.fileTime(QFileDevice::FileBirthTime).toMSecsSinceEpoch());
+#endif
+}
+
+bool ClaimDirectory::isFor(const QDir& folder, const ClaimOptions& options) const {
+    return claims.absolutePath() == QDir(folder.filePath(folderName)).absolutePath() && instanceId == resolveId(options);
+}
+
+void ClaimDirectory::setLeaseTimeout(qint64 leaseTimeout) {
+    this->leaseTimeout = leaseTimeout;
+}
+
+QString ClaimDirectory::leasePath(const QString& id) const {
+    return claims.filePath(id + leaseSuffix);
+}
+
+QString ClaimDirectory::lockPath(const QString& identity) const {
+    return claims.filePath(identity + lockSuffix);
+}
+
+QByteArray ClaimDirectory::doneContent() const {
+    return instanceId.toUtf8() + doneSuffix;
+}
+
+bool ClaimDirectory::heartbeat() {
+    if (!claims.exists() && !claims.mkpath(".")) {
+        return false;
+    }
+    QMutexLocker locker(&mutex);
+    if (isClosed) {
+        return false;
+    }
+    // The content only has to change, the readers never compare it with their clock
+    QSaveFile lease(leasePath(instanceId));
+    if (!lease.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    lease.write(QByteArray::number(++heartbeatCounter));
+    return lease.commit();
+}
+
+bool ClaimDirectory::claim(const QFileInfo& file) {
+    const QString path = file.absoluteFilePath();
+    const QString before = identity(path);
+    if (before.isEmpty()) {
+        return false;
+    }
+    QFile lock(lockPath(before));
+    if (!lock.open(QIODevice::WriteOnly | QIODevice::NewOnly)) {
+        return false;
+    }
+    lock.write(instanceId.toUtf8());
+    lock.close();
+
+    // The lock must belong to the content that is under the name now, not to the one the listing saw
+    if (identity(path) != before) {
+        lock.remove();
+        return false;
+    }
+    QMutexLocker locker(&mutex);
+    held.insert(path, lock.fileName());
+    return true;
+}
+
+bool ClaimDirectory::complete(const QString& filePath) {
+    QString path;
+    {
+        QMutexLocker locker(&mutex);
+        path = held.take(filePath);
+    }
+    if (path.isEmpty()) {
+        return false;
+    }
+    QSaveFile lock(path);
+    if (!lock.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    lock.write(doneContent());
+    return lock.commit();
+}
+
+void ClaimDirectory::abandon(const QString& filePath) {
+    QString path;
+    {
+        QMutexLocker locker(&mutex);
+        path = held.take(filePath);
+    }
+    if (!path.isEmpty()) {
+        QFile::remove(path);
+    }
+}
+
+bool ClaimDirectory::markDone(const QString& filePath) {
+    const QString fileIdentity = identity(filePath);
+    if (fileIdentity.isEmpty() || (!claims.exists() && !claims.mkpath("."))) {
+        return false;
+    }
+    QFile lock(lockPath(fileIdentity));
+    if (!lock.open(QIODevice::WriteOnly | QIODevice::NewOnly)) {
+        return lock.exists();
+    }
+    const bool isWritten = lock.write(doneContent()) > 0;
+    lock.close();
+    return isWritten;
+}
+
+int ClaimDirectory::removeLocksOf(const QStringList& ids) {
+    int removed = 0;
+    for (const QString& name : claims.entryList({"*" + lockSuffix}, QDir::Files | QDir::Hidden)) {
+        QFile lock(claims.filePath(name));
+        // A lock that is still empty is being created right now, its owner is unknown. Done markers are never removed here
+        if (lock.open(QIODevice::ReadOnly) && ids.contains(QString::fromUtf8(lock.readAll()))) {
+            lock.close();
+            removed += lock.remove() ? 1 : 0;
+        }
+    }
+    return removed;
+}
+
+int ClaimDirectory::release() {
+    QHash<QString, QString> locks;
+    {
+        QMutexLocker locker(&mutex);
+        locks.swap(held);
+    }
+    int removed = 0;
+    for (const QString& lock : locks) {
+        removed += QFile::remove(lock) ? 1 : 0;
+    }
+    return removed;
+}
+
+int ClaimDirectory::collectMarkers() {
+    const qint64 now = clock.elapsed();
+    if (lastCollection >= 0 && now - lastCollection < leaseTimeout) {
+        return 0;
+    }
+    lastCollection = now;
+
+    QSet<QString> present;
+    for (const QString& name : folder.entryList(QDir::Files | QDir::Hidden)) {
+        present.insert(identity(folder.filePath(name)) + lockSuffix);
+    }
+    // A file missing from one listing may only be not visible yet (NFS caches directories), so it must stay missing for leaseTimeout
+    int removed = 0;
+    QHash<QString, qint64> stillAbsent;
+    for (const QString& name : claims.entryList({"*" + lockSuffix}, QDir::Files | QDir::Hidden)) {
+        if (present.contains(name)) {
+            continue;
+        }
+        const qint64 since = absentSince.value(name, now);
+        if (now - since >= leaseTimeout) {
+            removed += QFile::remove(claims.filePath(name)) ? 1 : 0;
+        } else {
+            stillAbsent.insert(name, since);
+        }
+    }
+    absentSince.swap(stillAbsent);
+    return removed;
+}
+
+int ClaimDirectory::recoverExpired() {
+    int recovered = 0;
+    if (!isLeftoverChecked) {
+        isLeftoverChecked = true;
+        recovered += removeLocksOf({instanceId});
+    }
+
+    QStringList expired;
+    const qint64 now = clock.elapsed();
+    for (const QString& name : claims.entryList({"*" + leaseSuffix}, QDir::Files | QDir::Hidden)) {
+        const QString id = name.left(name.size() - leaseSuffix.size());
+        if (id == instanceId) {
+            continue;
+        }
+        QFile lease(claims.filePath(name));
+        const QByteArray content = lease.open(QIODevice::ReadOnly) ? lease.readAll() : QByteArray();
+
+        auto it = observed.constFind(id);
+        if (it == observed.constEnd() || it.value().lease != content) {
+            observed.insert(id, Observation{content, now});
+        } else if (now - it.value().since >= leaseTimeout) {
+            expired.append(id);
+        }
+    }
+    collectMarkers();
+    if (expired.isEmpty()) {
+        return recovered;
+    }
+
+    // The locks go first: if this instance dies in between, the lease stays expired and the next observer finishes the work
+    recovered += removeLocksOf(expired);
+    for (const QString& id : expired) {
+        QFile::remove(leasePath(id));
+        observed.remove(id);
+    }
+    return recovered;
+}
+
+void ClaimDirectory::close() {
+    release();
+    QMutexLocker locker(&mutex);
+    if (!isClosed && heartbeatCounter > 0) {
+        QFile::remove(leasePath(instanceId));
+    }
+    isClosed = true;
+}
+
+}
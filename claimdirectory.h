@@ -0,0 +1,172 @@
+/**
+ * @file claimdirectory.h
+ * @brief Sharing of one input folder between several instances of the program
+ */
+#ifndef CLAIMDIRECTORY_H
+#define CLAIMDIRECTORY_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QDir>
+#include <QFileInfo>
+#include <QHash>
+#include <QMutex>
+#include <QElapsedTimer>
+
+/**
+ * @namespace nClaimDirectory
+ * @brief Contains class ClaimDirectory and struct ClaimOptions
+ */
+namespace nClaimDirectory {
+
+/**
+ * @struct ClaimOptions
+ * @brief Parameters of claiming
+ */
+struct ClaimOptions {
+    /**
+     * @brief instanceId Name of this instance. Must differ between the instances working with the folder.
+     * If empty, the host name and the process id are used
+     */
+    QString instanceId;
+    /**
+     * @brief leaseTimeout Time in ms during which the lease of another instance may stay unchanged before its claims are dropped
+     */
+    qint64 leaseTimeout = 60000;
+};
+
+/**
+ * @class ClaimDirectory
+ * @brief Claims files of the folder for this instance with lock files that are created exclusively (O_EXCL),
+ * so exactly one instance gets each file, also on NFS. The files themselves are not moved. No central service is needed.
+ *
+ * A lock is named after the identity of the file, not after its name: .claims/<inode>-<size>-<mtime>.claim.
+ * The identity is read again after the lock is created, so a claim made from an outdated listing fails instead of taking
+ * the new content of the name. A processed file keeps its lock as a done marker, and an output gets its done marker before
+ * it appears under a name that matches the masks, so neither is processed again by any instance. A marker is removed
+ * when its file has not been seen in the folder for leaseTimeout.
+ *
+ * Every instance keeps the lease file .claims/<instance id>.lease and rewrites it with a new number on each heartbeat.
+ * Other instances do not compare clocks: a lease is expired when its content has not changed for leaseTimeout
+ * measured by the observer. The unfinished locks of an expired instance are removed and its files are claimed again
+ * by the next scan. heartbeat, recoverExpired and setLeaseTimeout are called from one thread (the control thread
+ * of GeneralHandler), the other functions can be used from any thread
+ */
+class ClaimDirectory {
+    QDir folder;
+    QDir claims;
+    QString instanceId;
+    qint64 leaseTimeout;
+    quint64 heartbeatCounter;
+    QElapsedTimer clock;
+    /**
+     * @brief mutex Guards held, isClosed and heartbeatCounter
+     */
+    QMutex mutex;
+    /**
+     * @brief held Lock of each claimed file path that is not completed yet
+     */
+    QHash<QString, QString> held;
+    bool isLeftoverChecked;
+    bool isClosed;
+
+    /**
+     * @brief Observation Last seen content of a lease of another instance and when it was seen first
+     */
+    struct Observation {
+        QByteArray lease;
+        qint64 since;
+    };
+    QHash<QString, Observation> observed;
+    /**
+     * @brief absentSince Locks whose file was not in the folder at the last collection, and since when
+     */
+    QHash<QString, qint64> absentSince;
+    qint64 lastCollection;
+
+    QString leasePath(const QString& id) const;
+    QString lockPath(const QString& identity) const;
+    QByteArray doneContent() const;
+    int removeLocksOf(const QStringList& ids);
+    /**
+     * @brief collectMarkers Removes the locks whose files have been absent for leaseTimeout. Runs at most once per leaseTimeout
+     */
+    int collectMarkers();
+
+public:
+    static const QString folderName;
+
+    /**
+     * @brief ClaimDirectory Constructor
+     * @param folder Folder shared by the instances
+     * @param options Name of the instance and lease timeout
+     */
+    ClaimDirectory(const QDir& folder, const ClaimOptions& options);
+    /**
+     * @brief Destructor. Calls close
+     */
+    ~ClaimDirectory();
+    /**
+     * @brief identity Inode, size and modification time of the file, empty if it does not exist
+     * @param path Path of the file
+     */
+    static QString identity(const QString& path);
+    /**
+     * @brief id Name of this instance
+     */
+    const QString& id() const { return instanceId; }
+    /**
+     * @brief isFor Checks whether the claims were created for the folder and the instance name of the options
+     */
+    bool isFor(const QDir& folder, const ClaimOptions& options) const;
+    void setLeaseTimeout(qint64 leaseTimeout);
+    /**
+     * @brief heartbeat Renews the lease of this instance. Must be called more often than leaseTimeout
+     * @return False if the lease could not be written
+     */
+    bool heartbeat();
+    /**
+     * @brief claim Creates the lock of the current content of the file for this instance
+     * @param file File found in the shared folder, possibly by an outdated listing
+     * @return False if another instance holds or has processed this content, or the file has changed or disappeared
+     */
+    bool claim(const QFileInfo& file);
+    /**
+     * @brief complete Turns the lock of the claimed file into a done marker, so this content is not claimed again
+     * @param filePath Absolute path of the file passed to claim
+     * @return False if the file was not claimed or the marker could not be written
+     */
+    bool complete(const QString& filePath);
+    /**
+     * @brief abandon Removes the lock of the claimed file, so any instance can claim it again
+     * @param filePath Absolute path of the file passed to claim
+     */
+    void abandon(const QString& filePath);
+    /**
+     * @brief markDone Creates the done marker of an output before it is renamed to a name that matches the masks.
+     * A rename keeps the identity
+     * @param filePath Completely written and closed output
+     * @return False if the marker could not be created
+     */
+    bool markDone(const QString& filePath);
+    /**
+     * @brief release Removes the locks of the files that this instance has claimed and not completed
+     * @return Number of removed locks
+     */
+    int release();
+    /**
+     * @brief recoverExpired Removes the unfinished locks of the instances whose leases have expired. The first call also removes
+     * unfinished locks left by a previous run with the same id. From time to time removes the markers of files that are gone
+     * @return Number of files that can be claimed again
+     */
+    int recoverExpired();
+    /**
+     * @brief close Releases the claims and removes the lease of this instance, so the others do not wait for it to expire
+     */
+    void close();
+};
+
+}
+
+#endif // CLAIMDIRECTORY_H
@@ -0,0 +1,156 @@
+#include "commitstage.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QSet>
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace nCommitStage {
+
+namespace {
+
+#ifdef Q_OS_LINUX
+bool syncPath(const QString& path, bool onlyData) {
+    const int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    const int result = onlyData ? ::fdatasync(fd) : ::fsync(fd);
+    ::close(fd);
+    return result == 0;
+}
+
+bool syncFileSystem(const QString& path) {
+    const int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    const int result = ::syncfs(fd);
+    ::close(fd);
+    return result == 0;
+}
+#endif
+
+}
+
+CommitStage::CommitStage(const CommitOptions& options, QObject* parent) : QObject(parent), options(options) {}
+
+void CommitStage::add(const PendingFile& file) {
+    QList<PendingFile> batch;
+    {
+        QMutexLocker locker(&mutex);
+        pending.append(file);
+        if (pending.size() < options.batchSize) {
+            return;
+        }
+        batch.swap(pending);
+    }
+    commit(batch);
+}
+
+void CommitStage::flush() {
+    QList<PendingFile> batch;
+    {
+        QMutexLocker locker(&mutex);
+        batch.swap(pending);
+    }
+    if (!batch.isEmpty()) {
+        commit(batch);
+    }
+}
+
+void CommitStage::setNameAllocator(std::shared_ptr<nNameAllocator::NameAllocator> nameAllocator) {
+    this->nameAllocator = std::move(nameAllocator);
+}
+
+void CommitStage::commit(const QList<PendingFile>& batch) {
+#ifdef Q_OS_LINUX
+    if (options.useSyncfs) {
+        if (!syncFileSystem(QFileInfo(batch.first().temporaryPath).absolutePath())) {
+            emit logMessage("Failed to flush the file system before publishing " + batch.first().temporaryPath);
+        }
+    } else {
+        for (const PendingFile& file : batch) {
+            if (!syncPath(file.temporaryPath, true)) {
+                emit logMessage("Failed to flush " + file.temporaryPath);
+            }
+        }
+    }
+#endif
+
+    QSet<QString> targetFolders;
+    // With the final paths, AddCounter can have chosen another name than the target
+    QList<PendingFile> publishedFiles;
+    for (const PendingFile& file : batch) {
+        const QString target = publish(file);
+        if (target.isEmpty()) {
+            continue;
+        }
+        targetFolders.insert(QFileInfo(target).absolutePath());
+        publishedFiles.append(file);
+        publishedFiles.back().targetPath = target;
+    }
+
+    QSet<QString> inputFolders;
+#ifdef Q_OS_LINUX
+    for (const QString& folder : targetFolders) {
+        if (!syncPath(folder, false)) {
+            emit logMessage("Failed to flush folder " + folder);
+        }
+    }
+#endif
+    // Only now the new names survive a crash
+    for (const PendingFile& file : publishedFiles) {
+        emit published(file.sourcePath, file.targetPath);
+    }
+
+    for (const PendingFile& file : publishedFiles) {
+        if (file.inputPath.isEmpty()) {
+            continue;
+        }
+        if (!QFile::remove(file.inputPath)) {
+            emit logMessage("Input file was not deleted: " + file.inputPath);
+            continue;
+        }
+        inputFolders.insert(QFileInfo(file.inputPath).absolutePath());
+    }
+
+#ifdef Q_OS_LINUX
+    for (const QString& folder : inputFolders) {
+        if (!targetFolders.contains(folder) && !syncPath(folder, false)) {
+            emit logMessage("Failed to flush folder " + folder);
+        }
+    }
+#endif
+}
+
+QString CommitStage::publish(const PendingFile& file) {
+    if (file.noReplace) {
+        if (!nameAllocator) {
+            emit logMessage("No name allocator to publish " + file.temporaryPath);
+            return QString();
+        }
+        // Never replaces a file, see NameAllocator::publish
+        const QString target = nameAllocator->publish(file.temporaryPath, QFileInfo(file.targetPath).fileName());
+        if (target.isEmpty()) {
+            emit logMessage("Failed to rename " + file.temporaryPath + " to " + file.targetPath);
+        }
+        return target;
+    }
+#ifdef Q_OS_LINUX
+    if (::rename(QFile::encodeName(file.temporaryPath).constData(), QFile::encodeName(file.targetPath).constData()) == 0) {
+        return file.targetPath;
+    }
+#else
+    QFile::remove(file.targetPath);
+    if (QFile::rename(file.temporaryPath, file.targetPath)) {
+        return file.targetPath;
+    }
+#endif
+    emit logMessage("Failed to rename " + file.temporaryPath + " to " + file.targetPath);
+    return QString();
+}
+
+}
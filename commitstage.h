@@ -0,0 +1,120 @@
+/**
+ * @file commitstage.h
+ * @brief Durable batch publication of processed files
+ */
+#ifndef COMMITSTAGE_H
+#define COMMITSTAGE_H
+
+#include <QObject>
+#include <QString>
+#include <QList>
+#include <QMutex>
+#include <memory>
+#include "nameallocator.h"
+
+/**
+ * @namespace nCommitStage
+ * @brief Contains class CommitStage, struct CommitOptions and struct PendingFile
+ */
+namespace nCommitStage {
+
+/**
+ * @struct CommitOptions
+ * @brief Parameters of the commit stage
+ */
+struct CommitOptions {
+    /**
+     * @brief batchSize Number of finished files that are published together
+     */
+    int batchSize = 64;
+    /**
+     * @brief useSyncfs Flush the whole file system with one syncfs call instead of fdatasync for each file of the batch
+     */
+    bool useSyncfs = false;
+};
+
+/**
+ * @struct PendingFile
+ * @brief A completely written temporary file waiting for publication
+ */
+struct PendingFile {
+    QString temporaryPath;
+    QString targetPath;
+    /**
+     * @brief noReplace If the target exists, a counter is added to the name instead of overwriting
+     */
+    bool noReplace;
+    /**
+     * @brief inputPath Source file that is deleted after the result is published. Empty if it must be kept
+     */
+    QString inputPath;
+    /**
+     * @brief sourcePath Source file of the result, reported by CommitStage::published
+     */
+    QString sourcePath;
+};
+
+/**
+ * @class CommitStage
+ * @brief Groups finished files. For a batch the data is flushed once (syncfs or fdatasync), the files are renamed
+ * to their final names, each affected directory is flushed once, and only then are the source files deleted
+ */
+class CommitStage : public QObject {
+    Q_OBJECT
+
+    CommitOptions options;
+    QMutex mutex;
+    QList<PendingFile> pending;
+    std::shared_ptr<nNameAllocator::NameAllocator> nameAllocator;
+
+public:
+    /**
+     * @brief CommitStage Constructor
+     * @param options Size of the batch and the way to flush the data
+     */
+    explicit CommitStage(const CommitOptions& options, QObject* parent = nullptr);
+    /**
+     * @brief add Queues a file. Publishes the batch in the calling thread when it is full
+     * @param file Temporary file that was completely written and closed
+     */
+    void add(const PendingFile& file);
+    /**
+     * @brief flush Publishes all queued files. Must be called after all tasks of the cycle have finished
+     */
+    void flush();
+    /**
+     * @brief setNameAllocator Files with noReplace are published by the allocator, it is required for them
+     * @param nameAllocator Allocator of the target folder
+     */
+    void setNameAllocator(std::shared_ptr<nNameAllocator::NameAllocator> nameAllocator);
+
+protected:
+    /**
+     * @brief commit Makes the batch durable and publishes it
+     * @param batch Files to be published
+     */
+    void commit(const QList<PendingFile>& batch);
+    /**
+     * @brief publish Renames the file to its final name
+     * @param file File to be published
+     * @return Final path of the file or empty string on error
+     */
+    QString publish(const PendingFile& file);
+
+signals:
+    /**
+     * @brief logMessage Passes information up
+     * @param message Why the message was sent
+     */
+    void logMessage(const QString& message);
+    /**
+     * @brief published Notifies that the file has been durably published. Emitted in the thread that publishes the batch
+     * @param sourcePath Path of the source file
+     * @param targetPath Final path of the result
+     */
+    void published(const QString& sourcePath, const QString& targetPath);
+};
+
+}
+
+#endif // COMMITSTAGE_H
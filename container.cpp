@@ -0,0 +1,271 @@
+#include "container.h"
+#include <QDateTime>
+#include <QFileInfo>
+#include <QtEndian>
+#include <array>
+
+namespace nContainer {
+
+namespace {
+
+const char magic[] = "FRSEG001";
+const qint64 magicSize = 8;
+const qint64 footerSize = magicSize + 2 * sizeof(quint64);
+const QString partSuffix = ".part";
+
+template<typename T>
+void appendNumber(QByteArray& buffer, T value) {
+    const T littleEndian = qToLittleEndian(value);
+    buffer.append(reinterpret_cast<const char*>(&littleEndian), sizeof(T));
+}
+
+template<typename T>
+bool readNumber(const QByteArray& buffer, qint64& position, T& value) {
+    if (position + static_cast<qint64>(sizeof(T)) > buffer.size()) {
+        return false;
+    }
+    value = qFromLittleEndian<T>(buffer.constData() + position);
+    position += sizeof(T);
+    return true;
+}
+
+std::array<quint32, 256> makeCrcTable() {
+    std::array<quint32, 256> table{};
+    for (quint32 i = 0; i < 256; ++i) {
+        quint32 value = i;
+        for (int bit = 0; bit < 8; ++bit) {
+            value = (value & 1) ? (value >> 1) ^ 0xEDB88320u : value >> 1;
+        }
+        table[i] = value;
+    }
+    return table;
+}
+
+}
+
+const QString SegmentWriter::extension = ".frseg";
+
+quint32 crc32(const char* data, qint64 size, quint32 crc) {
+    static const std::array<quint32, 256> table = makeCrcTable();
+    crc = ~crc;
+    for (qint64 i = 0; i < size; ++i) {
+        crc = table[(crc ^ static_cast<uchar>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+SegmentWriter::SegmentWriter(const QDir& folder, const ContainerOptions& options) :
+    folder(folder), options(options), position(0), segmentNumber(0), isLost(false) {
+    prefix = "segment_" + QString::number(QDateTime::currentMSecsSinceEpoch());
+}
+
+SegmentWriter::~SegmentWriter() {
+    close();
+}
+
+bool SegmentWriter::openSegment() {
+    for (int attempt = 0; attempt < 1000; ++attempt) {
+        segment.setFileName(folder.filePath(prefix + "_" + QString::number(++segmentNumber) + extension + partSuffix));
+        if (segment.open(QIODevice::WriteOnly | QIODevice::NewOnly)) {
+            position = 0;
+            buffer.reserve(bufferSize + options.maxFileSize);
+            return true;
+        }
+        if (!segment.exists()) {
+            return false;
+        }
+    }
+    return false;
+}
+
+bool SegmentWriter::flushBuffer() {
+    if (buffer.isEmpty()) {
+        return true;
+    }
+    const bool written = segment.write(buffer) == buffer.size();
+    buffer.clear();
+    return written;
+}
+
+bool SegmentWriter::seal() {
+    const quint64 indexOffset = position;
+    for (const Entry& entry : index) {
+        const QByteArray name = entry.name.toUtf8();
+        appendNumber<quint32>(buffer, static_cast<quint32>(name.size()));
+        buffer.append(name);
+        appendNumber<quint64>(buffer, entry.offset);
+        appendNumber<quint64>(buffer, entry.length);
+        appendNumber<quint32>(buffer, entry.checksum);
+    }
+    buffer.append(magic, magicSize);
+    appendNumber<quint64>(buffer, indexOffset);
+    appendNumber<quint64>(buffer, static_cast<quint64>(index.size()));
+
+    if (!flushBuffer() || !segment.flush()) {
+        discard();
+        return false;
+    }
+    segment.close();
+    const QString partPath = segment.fileName();
+    const QString finalPath = partPath.left(partPath.size() - partSuffix.size());
+    if (!QFile::rename(partPath, finalPath)) {
+        discard();
+        return false;
+    }
+
+    // The sources are deleted only when their data is reachable through a complete segment
+    for (const QString& input : inputsToRemove) {
+        QFile::remove(input);
+    }
+    index.clear();
+    names.clear();
+    inputsToRemove.clear();
+    position = 0;
+    return true;
+}
+
+void SegmentWriter::discard() {
+    // After a failed write the file can end anywhere inside an entry, so the whole segment goes. Its sources are kept
+    segment.close();
+    segment.remove();
+    buffer.clear();
+    index.clear();
+    names.clear();
+    inputsToRemove.clear();
+    position = 0;
+    isLost = true;
+}
+
+bool SegmentWriter::append(const QString& name, const QByteArray& data, const QString& inputPath) {
+    QMutexLocker locker(&mutex);
+    if (!segment.isOpen() && !openSegment()) {
+        return false;
+    }
+
+    Entry entry;
+    entry.name = name;
+    const QFileInfo file(name);
+    for (int counter = 1; names.contains(entry.name); ++counter) {
+        entry.name = file.completeBaseName() + "_" + QString::number(counter) + "." + file.suffix();
+    }
+    names.insert(entry.name);
+    entry.offset = position;
+    entry.length = static_cast<quint64>(data.size());
+    entry.checksum = crc32(data.constData(), data.size());
+    index.append(entry);
+    if (!inputPath.isEmpty()) {
+        inputsToRemove.append(inputPath);
+    }
+
+    buffer.append(data);
+    position += data.size();
+    if (buffer.size() >= bufferSize && !flushBuffer()) {
+        discard();
+        return false;
+    }
+    if (static_cast<qint64>(position) >= options.segmentSize) {
+        return seal();
+    }
+    return true;
+}
+
+bool SegmentWriter::close() {
+    QMutexLocker locker(&mutex);
+    const bool isSealed = !segment.isOpen() || seal();
+    return isSealed && !isLost;
+}
+
+bool SegmentReader::open(const QString& path) {
+    index.clear();
+    byName.clear();
+    segment.close();
+    segment.setFileName(path);
+    if (!segment.open(QIODevice::ReadOnly) || segment.size() < footerSize) {
+        return false;
+    }
+
+    const qint64 footerOffset = segment.size() - footerSize;
+    segment.seek(footerOffset);
+    const QByteArray footer = segment.read(footerSize);
+    if (footer.size() != footerSize || footer.left(magicSize) != QByteArray(magic, magicSize)) {
+        return false;
+    }
+    qint64 footerPosition = magicSize;
+    quint64 indexOffset = 0;
+    quint64 count = 0;
+    readNumber(footer, footerPosition, indexOffset);
+    readNumber(footer, footerPosition, count);
+    if (indexOffset > static_cast<quint64>(footerOffset)) {
+        return false;
+    }
+
+    segment.seek(static_cast<qint64>(indexOffset));
+    const QByteArray indexData = segment.read(footerOffset - static_cast<qint64>(indexOffset));
+    qint64 indexPosition = 0;
+    for (quint64 i = 0; i < count; ++i) {
+        quint32 nameLength = 0;
+        if (!readNumber(indexData, indexPosition, nameLength) || indexPosition + nameLength > indexData.size()) {
+            return false;
+        }
+        Entry entry;
+        entry.name = QString::fromUtf8(indexData.constData() + indexPosition, nameLength);
+        indexPosition += nameLength;
+        if (!readNumber(indexData, indexPosition, entry.offset) || !readNumber(indexData, indexPosition, entry.length)
+            || !readNumber(indexData, indexPosition, entry.checksum) || entry.offset + entry.length > indexOffset) {
+            return false;
+        }
+        byName.insert(entry.name, index.size());
+        index.append(entry);
+    }
+    return true;
+}
+
+int SegmentReader::find(const QString& name) const {
+    return byName.value(name, -1);
+}
+
+QByteArray SegmentReader::read(int entry, bool* ok) {
+    if (ok) {
+        *ok = false;
+    }
+    if (entry < 0 || entry >= index.size() || !segment.seek(static_cast<qint64>(index.at(entry).offset))) {
+        return QByteArray();
+    }
+    const QByteArray data = segment.read(static_cast<qint64>(index.at(entry).length));
+    if (ok) {
+        *ok = data.size() == static_cast<qint64>(index.at(entry).length)
+              && crc32(data.constData(), data.size()) == index.at(entry).checksum;
+    }
+    return data;
+}
+
+bool extract(const QString& segmentPath, const QDir& folder, QString* error) {
+    SegmentReader reader;
+    if (!reader.open(segmentPath)) {
+        if (error) {
+            *error = "Not a complete segment: " + segmentPath;
+        }
+        return false;
+    }
+    for (int i = 0; i < reader.entries().size(); ++i) {
+        bool ok = false;
+        const QByteArray data = reader.read(i, &ok);
+        if (!ok) {
+            if (error) {
+                *error = "Damaged file in the segment: " + reader.entries().at(i).name;
+            }
+            return false;
+        }
+        // Only the file name is used so that an entry can not point outside the folder
+        QFile output(folder.filePath(QFileInfo(reader.entries().at(i).name).fileName()));
+        if (!output.open(QIODevice::WriteOnly) || output.write(data) != data.size()) {
+            if (error) {
+                *error = "Failed to write " + output.fileName();
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,171 @@
+/**
+ * @file container.h
+ * @brief Container format for many small output files: segment files with a trailing index
+ */
+#ifndef CONTAINER_H
+#define CONTAINER_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QDir>
+#include <QFile>
+#include <QHash>
+#include <QSet>
+#include <QList>
+#include <QMutex>
+
+/**
+ * @namespace nContainer
+ * @brief Contains classes SegmentWriter and SegmentReader, structs ContainerOptions and Entry and function extract.
+ *
+ * Layout of a segment: the data of the entries one after another, then the index, then the footer.
+ * Index record: quint32 name length, UTF-8 name, quint64 offset, quint64 length, quint32 CRC-32 of the data.
+ * Footer: 8 bytes of magic "FRSEG001", quint64 offset of the index, quint64 number of entries.
+ * All numbers are little-endian
+ */
+namespace nContainer {
+
+/**
+ * @struct ContainerOptions
+ * @brief Parameters of the container output
+ */
+struct ContainerOptions {
+    /**
+     * @brief maxFileSize Files up to this size are appended to a segment, larger files are written as usual
+     */
+    qint64 maxFileSize = 64 * 1024;
+    /**
+     * @brief segmentSize A new segment is started when the current one reaches this size
+     */
+    qint64 segmentSize = 256 * 1024 * 1024;
+};
+
+/**
+ * @struct Entry
+ * @brief One file inside a segment
+ */
+struct Entry {
+    QString name;
+    quint64 offset;
+    quint64 length;
+    quint32 checksum;
+};
+
+/**
+ * @brief crc32 Calculates CRC-32 (IEEE 802.3)
+ * @param data Data
+ * @param size Size of data in bytes
+ * @param crc Result for the previous part of the data, allows calculating in parts
+ */
+quint32 crc32(const char* data, qint64 size, quint32 crc = 0);
+
+/**
+ * @class SegmentWriter
+ * @brief Appends files to segments in one folder. Can be used from several tasks at once.
+ * A segment is written under a temporary name and gets the .frseg extension only after its index is written
+ */
+class SegmentWriter {
+    QDir folder;
+    ContainerOptions options;
+    QString prefix;
+    QMutex mutex;
+    QFile segment;
+    QByteArray buffer;
+    quint64 position;
+    int segmentNumber;
+    QList<Entry> index;
+    /**
+     * @brief names Names of the entries of the current segment
+     */
+    QSet<QString> names;
+    QStringList inputsToRemove;
+    /**
+     * @brief isLost A segment of the writer has been dropped after a failed write, the files appended to it are not in any segment
+     */
+    bool isLost;
+    static constexpr qint64 bufferSize = 4 * 1024 * 1024;
+
+    bool openSegment();
+    bool flushBuffer();
+    bool seal();
+    void discard();
+
+public:
+    static const QString extension;
+
+    /**
+     * @brief SegmentWriter Constructor
+     * @param folder Folder for the segments
+     * @param options Threshold of a small file and size of a segment
+     */
+    SegmentWriter(const QDir& folder, const ContainerOptions& options);
+    /**
+     * @brief Destructor. Seals the current segment
+     */
+    ~SegmentWriter();
+    /**
+     * @brief maxFileSize Files up to this size should be passed to append
+     */
+    qint64 maxFileSize() const { return options.maxFileSize; }
+    /**
+     * @brief append Appends the processed file to the current segment
+     * @param name Name of the file inside the segment. Names are unique within a segment: if the name is taken,
+     * a counter is added as in the AddCounter mode (name_1.ext, name_2.ext ...)
+     * @param data Processed data
+     * @param inputPath Source file that is deleted after the segment is sealed. Empty if it must be kept
+     * @return False if the data could not be written
+     */
+    bool append(const QString& name, const QByteArray& data, const QString& inputPath = QString());
+    /**
+     * @brief close Seals the current segment. Must be called after all tasks of the cycle have finished
+     * @return False if the segment could not be completed or an earlier segment of the writer has been dropped
+     */
+    bool close();
+};
+
+/**
+ * @class SegmentReader
+ * @brief Random access to the files of a segment
+ */
+class SegmentReader {
+    QFile segment;
+    QList<Entry> index;
+    QHash<QString, int> byName;
+
+public:
+    /**
+     * @brief open Opens the segment and reads its index
+     * @param path Path of the segment
+     * @return False if the file is not a complete segment
+     */
+    bool open(const QString& path);
+    /**
+     * @brief entries All files of the segment in the order they were written
+     */
+    const QList<Entry>& entries() const { return index; }
+    /**
+     * @brief find Returns the index of the file with the specified name or -1.
+     * SegmentWriter keeps the names unique, if a segment has repeated names the last file is returned
+     */
+    int find(const QString& name) const;
+    /**
+     * @brief read Reads the file and checks its checksum
+     * @param entry Index of the file in entries()
+     * @param ok Is set to false if the file could not be read or is damaged
+     */
+    QByteArray read(int entry, bool* ok = nullptr);
+};
+
+/**
+ * @brief extract Writes all files of the segment to the folder
+ * @param segmentPath Path of the segment
+ * @param folder Folder for the files, existing files are overwritten
+ * @param error Description of the problem if the function returns false
+ * @return False if the segment is damaged or a file could not be written
+ */
+bool extract(const QString& segmentPath, const QDir& folder, QString* error = nullptr);
+
+}
+
+#endif // CONTAINER_H
@@ -0,0 +1,121 @@
+#include "dispatchqueue.h"
+#include <algorithm>
+
+namespace nDispatchQueue {
+
+bool DispatchQueue::ByPriority::operator()(const Entry& left, const Entry& right) const {
+    if (left.key != right.key) {
+        return left.key < right.key;
+    }
+    if (left.size != right.size) {
+        return left.size > right.size;
+    }
+    return left.ticket > right.ticket;
+}
+
+bool DispatchQueue::ByDeadline::operator()(const Entry& left, const Entry& right) const {
+    if (left.key != right.key) {
+        return left.key > right.key;
+    }
+    return left.ticket > right.ticket;
+}
+
+DispatchQueue::DispatchQueue(qint64 agingInterval) :
+    agingInterval(agingInterval), tickets(0), remaining(0) {}
+
+void DispatchQueue::push(quint64 batch, const nJobTable::JobTable& jobs, const QList<PriorityClass>& classes) {
+    byPriority.reserve(byPriority.size() + jobs.size());
+    for (int i = 0; i < jobs.size(); ++i) {
+        const nJobTable::Job& job = jobs.at(i);
+        const bool hasClass = static_cast<qint64>(job.priorityClass) < classes.size();
+        const int priority = hasClass ? classes.at(job.priorityClass).priority : 0;
+        const qint64 maxLatency = hasClass ? classes.at(job.priorityClass).maxLatency : 0;
+        const quint64 ticket = tickets++;
+
+        byPriority.push_back(Entry{priority * agingInterval - job.arrival, job.size, ticket, maxLatency > 0, Item{batch, i}});
+        std::push_heap(byPriority.begin(), byPriority.end(), ByPriority());
+        if (maxLatency > 0) {
+            byDeadline.push_back(Entry{job.arrival + maxLatency / 2, job.size, ticket, true, Item{batch, i}});
+            std::push_heap(byDeadline.begin(), byDeadline.end(), ByDeadline());
+        }
+        ++remaining;
+    }
+}
+
+bool DispatchQueue::take(const Entry& entry) {
+    // A job is in both queues when its class has a deadline, the copy left in the other queue is skipped later
+    if (taken.remove(entry.ticket)) {
+        return false;
+    }
+    if (entry.isInBoth) {
+        taken.insert(entry.ticket);
+    }
+    --remaining;
+    return true;
+}
+
+DispatchQueue::Item DispatchQueue::next(qint64 now) {
+    while (!byDeadline.empty()) {
+        const Entry top = byDeadline.front();
+        if (!taken.contains(top.ticket) && top.key > now) {
+            break;
+        }
+        std::pop_heap(byDeadline.begin(), byDeadline.end(), ByDeadline());
+        byDeadline.pop_back();
+        if (take(top)) {
+            return top.item;
+        }
+    }
+    while (!byPriority.empty()) {
+        const Entry top = byPriority.front();
+        std::pop_heap(byPriority.begin(), byPriority.end(), ByPriority());
+        byPriority.pop_back();
+        if (take(top)) {
+            return top.item;
+        }
+    }
+    return Item{0, -1};
+}
+
+void LatencyStats::add(int priorityClass, qint64 latency) {
+    QMutexLocker locker(&mutex);
+    if (priorityClass < 0) {
+        return;
+    }
+    if (static_cast<size_t>(priorityClass) >= samples.size()) {
+        samples.resize(priorityClass + 1);
+        positions.resize(priorityClass + 1, 0);
+    }
+    std::vector<qint64>& values = samples[priorityClass];
+    if (values.size() < windowSize) {
+        values.push_back(latency);
+    } else {
+        values[positions[priorityClass]] = latency;
+        positions[priorityClass] = (positions[priorityClass] + 1) % windowSize;
+    }
+}
+
+QList<LatencyStats::Summary> LatencyStats::summary() {
+    QMutexLocker locker(&mutex);
+    QList<Summary> result;
+    for (size_t i = 0; i < samples.size(); ++i) {
+        if (samples[i].empty()) {
+            continue;
+        }
+        std::vector<qint64> sorted = samples[i];
+        std::sort(sorted.begin(), sorted.end());
+        const auto percentile = [&sorted](int percent) {
+            return sorted[(sorted.size() - 1) * percent / 100];
+        };
+        result.append(Summary{static_cast<int>(i), sorted.size(), percentile(50), percentile(95), percentile(99), sorted.back()});
+    }
+    return result;
+}
+
+void LatencyStats::clear() {
+    QMutexLocker locker(&mutex);
+    samples.clear();
+    positions.clear();
+}
+
+}
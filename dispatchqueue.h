@@ -0,0 +1,156 @@
+/**
+ * @file dispatchqueue.h
+ * @brief Order in which the found files are given to the pool
+ */
+#ifndef DISPATCHQUEUE_H
+#define DISPATCHQUEUE_H
+
+#include <QString>
+#include <QList>
+#include <QMutex>
+#include <QSet>
+#include <memory>
+#include <vector>
+#include "jobtable.h"
+
+/**
+ * @namespace nDispatchQueue
+ * @brief Contains classes DispatchQueue and LatencyStats and struct PriorityClass
+ */
+namespace nDispatchQueue {
+
+/**
+ * @struct PriorityClass
+ * @brief Priority of the files of one mask. Written in the mask as *.bin@10 or *.bin@10/2000
+ */
+struct PriorityClass {
+    /**
+     * @brief name Mask as entered by the user, used in the telemetry
+     */
+    QString name;
+    /**
+     * @brief priority Files with a higher value are started first
+     */
+    int priority = 0;
+    /**
+     * @brief maxLatency Target time in ms from arrival to start, 0 if there is none
+     */
+    qint64 maxLatency = 0;
+};
+
+/**
+ * @class DispatchQueue
+ * @brief Priority queue of the jobs of all cycles that have not been started yet. It lives as long as the dispatcher,
+ * the jobs of a new scan are pushed into it while the jobs of the previous ones are still being dispatched.
+ *
+ * A job waiting for agingInterval ms gains one priority level, so bulk work is not starved by a constant flow of urgent files.
+ * Because all jobs age at the same rate, the aged priority is a fixed key: priority * agingInterval - arrival.
+ * Within the same key smaller files go first, then the jobs pushed earlier. A job of a class with maxLatency is started
+ * before all others once half of its target has passed, in the order in which the jobs reach that point
+ */
+class DispatchQueue {
+public:
+    /**
+     * @struct Item
+     * @brief Job of a batch: the number of the cycle and the index of the job in its table
+     */
+    struct Item {
+        quint64 batch;
+        int job;
+    };
+
+private:
+    /**
+     * @brief Entry Priority queue: the aged priority and the size. Deadline queue: the promotion time.
+     * ticket is the order of the push, isInBoth marks a job that has a copy in each queue
+     */
+    struct Entry {
+        qint64 key;
+        qint64 size;
+        quint64 ticket;
+        bool isInBoth;
+        Item item;
+    };
+    struct ByPriority {
+        bool operator()(const Entry& left, const Entry& right) const;
+    };
+    struct ByDeadline {
+        bool operator()(const Entry& left, const Entry& right) const;
+    };
+
+    qint64 agingInterval;
+    std::vector<Entry> byPriority;
+    std::vector<Entry> byDeadline;
+    /**
+     * @brief taken Tickets of the started jobs whose copy is still in the other queue
+     */
+    QSet<quint64> taken;
+    quint64 tickets;
+    int remaining;
+
+    bool take(const Entry& entry);
+
+public:
+    /**
+     * @brief DispatchQueue Creates an empty queue
+     * @param agingInterval Waiting time in ms that is worth one priority level
+     */
+    explicit DispatchQueue(qint64 agingInterval = 10000);
+    /**
+     * @brief push Adds all jobs of the table
+     * @param batch Number of the cycle, returned with each of its jobs
+     * @param jobs Table of the cycle, Job::priorityClass refers to classes
+     * @param classes Priority classes of the masks of the cycle
+     */
+    void push(quint64 batch, const nJobTable::JobTable& jobs, const QList<PriorityClass>& classes);
+    bool isEmpty() const { return remaining == 0; }
+    /**
+     * @brief size Number of the jobs that have not been started
+     */
+    int size() const { return remaining; }
+    /**
+     * @brief next Removes the job that must be started now
+     * @param now Current time in ms since epoch
+     * @return The job, its index is -1 if the queue is empty
+     */
+    Item next(qint64 now);
+};
+
+/**
+ * @class LatencyStats
+ * @brief Time from arrival to start of the last files of each priority class. Can be used from several threads
+ */
+class LatencyStats {
+    QMutex mutex;
+    std::vector<std::vector<qint64>> samples;
+    std::vector<size_t> positions;
+    static constexpr size_t windowSize = 10000;
+
+public:
+    /**
+     * @struct Summary
+     * @brief Percentiles of the queue latency in ms
+     */
+    struct Summary {
+        int priorityClass;
+        size_t count;
+        qint64 p50;
+        qint64 p95;
+        qint64 p99;
+        qint64 max;
+    };
+
+    /**
+     * @brief add Remembers the latency, only the last windowSize values of a class are kept
+     */
+    void add(int priorityClass, qint64 latency);
+    /**
+     * @brief summary Percentiles of every class that has values
+     */
+    QList<Summary> summary();
+    void clear();
+};
+
+}
+
+#endif // DISPATCHQUEUE_H
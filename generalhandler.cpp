@@ -1,21 +1,225 @@
 #include "generalhandler.h"
 #include <iostream>
+#include <QDateTime>
+#include <functional>
 
 namespace nGeneralHandler {
 
+namespace {
+
+/**
+ * @class CycleObserver
+ * @brief Receives the reports of all tasks of a cycle in their worker threads. Progress and logs are forwarded as signals
+ * of the handler and reach the UI as queued events, the completion is counted immediately and does not wait for any event loop.
+ * A file stays in flight and keeps its claim until its result is published: at the end of its task, when the commit stage
+ * publishes it, or when the segment is sealed
+ */
+class CycleObserver : public nLocalHandler::TaskObserver {
+    GeneralHandler* handler;
+    std::shared_ptr<const nJobTable::JobTable> jobs;
+    std::shared_ptr<nThroughputModel::ThroughputModel> throughputModel;
+    std::shared_ptr<nClaimDirectory::ClaimDirectory> claims;
+    std::shared_ptr<InFlightFiles> inFlight;
+    std::function<void()> wakeDispatcher;
+    bool isCommitted;
+    QMutex mutex;
+    /**
+     * @brief appended Jobs whose results are in the segment, reported by taskAppended before their end
+     */
+    QSet<int> appended;
+    /**
+     * @brief committing Sources whose results are queued in the commit stage
+     */
+    QSet<QString> committing;
+    /**
+     * @brief published Sources published by the commit stage before their task reported the end
+     */
+    QSet<QString> published;
+    /**
+     * @brief sealing Sources whose results wait for the segment to be sealed
+     */
+    QStringList sealing;
+
+    void settle(const QString& path, bool isDone) {
+        // A processed file keeps its lock as a done marker, the lock of a failed or stopped file is removed,
+        // so any instance can take it again
+        if (claims && !isDone) {
+            claims->abandon(path);
+        } else if (claims && !claims->complete(path)) {
+            emit handler->sendLog("Failed to mark the file as processed: " + path);
+        }
+        QMutexLocker locker(&inFlight->mutex);
+        inFlight->paths.remove(path);
+    }
+
+public:
+    /**
+     * @brief activeCount Tasks given to the pool that have not finished yet
+     */
+    std::atomic<int> activeCount;
+
+    /**
+     * @param isCommitted The cycle has a commit stage, the results that are not in the segment are published by it
+     * @param wakeDispatcher Called after each task, so the dispatcher gives the free slot to the next job at once
+     */
+    CycleObserver(GeneralHandler* handler, std::shared_ptr<const nJobTable::JobTable> jobs,
+                  std::shared_ptr<nThroughputModel::ThroughputModel> throughputModel,
+                  std::shared_ptr<nClaimDirectory::ClaimDirectory> claims, std::shared_ptr<InFlightFiles> inFlight,
+                  bool isCommitted, std::function<void()> wakeDispatcher) :
+        handler(handler), jobs(std::move(jobs)), throughputModel(std::move(throughputModel)), claims(std::move(claims)),
+        inFlight(std::move(inFlight)), wakeDispatcher(std::move(wakeDispatcher)), isCommitted(isCommitted), activeCount(0) {}
+
+    void taskProgress(int job, size_t percent) override {
+        emit handler->sendStatusFile(jobs->cycle(), job, percent);
+    }
+
+    void taskLog(const QString& message) override {
+        emit handler->sendLog(message);
+    }
+
+    void taskAppended(int job) override {
+        QMutexLocker locker(&mutex);
+        appended.insert(job);
+    }
+
+    void taskFinished(int job, bool isCompleted) override {
+        throughputModel->finish(job);
+        const QString path = jobs->fileInfo(job).absoluteFilePath();
+        bool isWaiting = false;
+        if (isCompleted) {
+            QMutexLocker locker(&mutex);
+            if (appended.remove(job)) {
+                sealing.append(path);
+                isWaiting = true;
+            } else if (isCommitted && !published.remove(path)) {
+                committing.insert(path);
+                isWaiting = true;
+            }
+        }
+        if (!isWaiting) {
+            settle(path, isCompleted);
+        }
+        activeCount.fetch_sub(1);
+        wakeDispatcher();
+    }
+
+    /**
+     * @brief filePublished Connected directly to CommitStage::published, runs in the thread that commits the batch
+     */
+    void filePublished(const QString& sourcePath) {
+        {
+            QMutexLocker locker(&mutex);
+            if (!committing.remove(sourcePath)) {
+                published.insert(sourcePath);
+                return;
+            }
+        }
+        settle(sourcePath, true);
+    }
+
+    /**
+     * @brief settleWaiting Called after the last flush of the commit stage and after the segment is closed
+     * @param isSealed The segment has been sealed, so the files appended to it are published
+     */
+    void settleWaiting(bool isSealed) {
+        QSet<QString> unpublished;
+        QStringList appendedPaths;
+        {
+            QMutexLocker locker(&mutex);
+            // The stage has already logged why these were not published, the next scan finds them again
+            unpublished.swap(committing);
+            appendedPaths.swap(sealing);
+        }
+        for (const QString& path : unpublished) {
+            settle(path, false);
+        }
+        for (const QString& path : appendedPaths) {
+            settle(path, isSealed);
+        }
+    }
+};
+
+}
+
+struct CycleState {
+    std::shared_ptr<const nJobTable::JobTable> jobs;
+    CycleSettings settings;
+    std::shared_ptr<nCommitStage::CommitStage> commitStage;
+    std::shared_ptr<nContainer::SegmentWriter> segmentWriter;
+    std::shared_ptr<nThroughputModel::ThroughputModel> throughputModel;
+    std::shared_ptr<CycleObserver> observer;
+    /**
+     * @brief pending Jobs that are still in the dispatch queue
+     */
+    int pending;
+    QElapsedTimer estimateTimer;
+};
+
 GeneralHandler::GeneralHandler(QObject *parent) : QObject(parent) {
+    qRegisterMetaType<std::shared_ptr<QList<IncorrectInput>>>("std::shared_ptr<QList<IncorrectInput>>");
+    qRegisterMetaType<std::shared_ptr<const nJobTable::JobTable>>("std::shared_ptr<const nJobTable::JobTable>");
+    qRegisterMetaType<size_t>("size_t");
+    qRegisterMetaType<QList<nThroughputModel::DeviceTotal>>("QList<nThroughputModel::DeviceTotal>");
+    qRegisterMetaType<nThroughputModel::Estimate>("nThroughputModel::Estimate");
+    latencyStats = std::make_shared<nDispatchQueue::LatencyStats>();
     incorrectParams = std::make_shared<QList<IncorrectInput>>();
+    inFlight = std::make_shared<InFlightFiles>();
     pool = QThreadPool::globalInstance();
-    timer = new QTimer(this);
-    connect(timer, &QTimer::timeout, this, [this]() {
+
+    controlThread = new QThread(this);
+    controlThread->setObjectName("GeneralHandler control");
+    control = new QObject();
+    control->moveToThread(controlThread);
+    timer = new QTimer();
+    timer->moveToThread(controlThread);
+    connect(timer, &QTimer::timeout, control, [this]() {
         findFilesByMask();
     });
+    heartbeatTimer = new QTimer();
+    heartbeatTimer->moveToThread(controlThread);
+    connect(heartbeatTimer, &QTimer::timeout, control, [this]() {
+        if (claims && !claims->heartbeat()) {
+            emit sendLog("Failed to renew the lease of " + claims->id());
+        }
+    });
+    dispatcher = std::thread([this]() {
+        runDispatcher();
+    });
+}
+
+GeneralHandler::~GeneralHandler() {
+    stopped.store(true);
+    paused.store(false);
+    if (controlThread->isRunning()) {
+        QMetaObject::invokeMethod(control, [this]() {
+            timer->stop();
+            heartbeatTimer->stop();
+        }, Qt::BlockingQueuedConnection);
+        controlThread->quit();
+        controlThread->wait();
+    }
+    {
+        // No scan pushes a cycle any more, the dispatcher gives back the queued files and waits for the running tasks
+        QMutexLocker locker(&dispatchMutex);
+        isQuitting = true;
+        inboxChanged.wakeAll();
+    }
+    if (dispatcher.joinable()) {
+        dispatcher.join();
+    }
+    // Unfinished claims and the lease are removed, so the other instances do not wait for the lease to expire
+    if (claims) {
+        claims->close();
+    }
+    delete timer;
+    delete heartbeatTimer;
+    delete control;
 }
 
 bool GeneralHandler::getInputParams(const QString& key, const bool& isNeedDelete,
                                     const nLocalHandler::ConflictMode& conflict, const CommonModeTreatment& mode,
                                     const QString& pathOutputFolder, const QString& pathInputFolder,
-                                    const QString& mask) {
+                                    const QString& mask, const StartOptions& options) {
     dirOutputFolder = QDir(pathOutputFolder);
     dirInputFolder = QDir(pathInputFolder);
 
@@ -27,15 +231,53 @@ bool GeneralHandler::getInputParams(const QString& key, const bool& isNeedDelete
         incorrectParams->append(IncorrectInput::InputFolder);
     }
 
-    if (key.length() != 18) {
+    auto parsedTransform = nTransform::create(nXorKey::XorKey::fromString(key, options.keyFormat), options.transformOptions);
+    if (!parsedTransform) {
         incorrectParams->append(IncorrectInput::Key);
     }
 
+    QHash<QString, std::shared_ptr<const nTransform::Transform>> parsedTransformsByMask;
+    QList<nDispatchQueue::PriorityClass> parsedClasses;
+    QHash<QString, int> parsedClassByMask;
     masks = mask.split(QRegularExpression("[,; ]+"), Qt::SkipEmptyParts);
     for (auto& m : masks) {
+        nDispatchQueue::PriorityClass priorityClass;
+        const qint64 at = m.indexOf("@");
+        if (at != -1) {
+            const QStringList spec = m.mid(at + 1).split("/");
+            bool isPriority = false;
+            bool isLatency = true;
+            priorityClass.priority = spec.first().toInt(&isPriority);
+            if (spec.size() > 1) {
+                priorityClass.maxLatency = spec.at(1).toLongLong(&isLatency);
+            }
+            if (!isPriority || !isLatency || spec.size() > 2 || priorityClass.maxLatency < 0) {
+                incorrectParams->append(IncorrectInput::Mask);
+                continue;
+            }
+            m = m.left(at);
+        }
+
+        const qint64 separator = m.indexOf(":");
+        QString maskKey;
+        if (separator != -1) {
+            maskKey = m.mid(separator + 1);
+            m = m.left(separator);
+        }
+        priorityClass.name = m;
         if (m.startsWith("*.")) {
             m.remove(0, 2);
         }
+        if (separator != -1) {
+            auto maskTransform = nTransform::create(nXorKey::XorKey::fromString(maskKey, options.keyFormat), options.transformOptions);
+            if (!maskTransform) {
+                incorrectParams->append(IncorrectInput::Key);
+                continue;
+            }
+            parsedTransformsByMask.insert(m, maskTransform);
+        }
+        parsedClassByMask.insert(m, parsedClasses.size());
+        parsedClasses.append(priorityClass);
     }
 
     if (masks.isEmpty()) {
@@ -48,15 +290,29 @@ bool GeneralHandler::getInputParams(const QString& key, const bool& isNeedDelete
         return true;
     }
 
-    this->key = key;
+    this->options = options;
+    this->transform = parsedTransform;
+    this->transformsByMask = parsedTransformsByMask;
+    priorityClasses = parsedClasses;
+    classByMask = parsedClassByMask;
+    arrivals.clear();
+    lastScan = 0;
+    latencyStats->clear();
     this->isNeedDelete = isNeedDelete;
     this->conflict = conflict;
+    nameAllocator = std::make_shared<nNameAllocator::NameAllocator>(dirOutputFolder);
+    // Claims of a running cycle stay valid: the same claims are kept for the same folder and instance,
+    // otherwise the old ones are closed when their last cycle ends
+    if (!options.isClaiming) {
+        claims.reset();
+    } else if (claims && claims->isFor(dirOutputFolder, options.claimOptions)) {
+        claims->setLeaseTimeout(options.claimOptions.leaseTimeout);
+    } else {
+        claims = std::make_shared<nClaimDirectory::ClaimDirectory>(dirOutputFolder, options.claimOptions);
+    }
     this->mode = mode;
-    this->timerValue = timerValue;
-    cycleInProgress = false;
     paused.store(false);
     stopped.store(false);
-    activeTasks.store(0);
     emit sendLog("The specified parameters have been read");
     return false;
 }
@@ -65,16 +321,28 @@ void GeneralHandler::start(const QString& key, const bool& isNeedDelete,
                            const nLocalHandler::ConflictMode& conflict, const CommonModeTreatment& mode,
                            const QString& pathOutputFolder, const QString& pathInputFolder,
                            const QString& mask) {
-    stopped.store(true);
-    stopped.store(false);
-    if (getInputParams(key, isNeedDelete, conflict, mode, pathOutputFolder, pathInputFolder, mask)) {
-        return;
-    }
-    if (mode.mode == ModeTreatment::OneTimeTreatment) {
-        findFilesByMask();
-    } else {
-        timer->start(mode.counterToTimer * 1000);
+    if (!controlThread->isRunning()) {
+        controlThread->start();
     }
+    // Everything from here runs on the control thread, so a busy UI does not delay scanning and scheduling.
+    // The options are copied here: the setters may change them again while the start is queued
+    QMetaObject::invokeMethod(control, [=, startOptions = nextOptions]() {
+        if (getInputParams(key, isNeedDelete, conflict, mode, pathOutputFolder, pathInputFolder, mask, startOptions)) {
+            return;
+        }
+        heartbeatTimer->stop();
+        if (claims) {
+            if (!claims->heartbeat()) {
+                emit sendLog("Failed to write the lease of " + claims->id());
+            }
+            heartbeatTimer->start(static_cast<int>(std::max<qint64>(1, options.claimOptions.leaseTimeout / 4)));
+        }
+        if (mode.mode == ModeTreatment::OneTimeTreatment) {
+            findFilesByMask();
+        } else {
+            timer->start(mode.counterToTimer * 1000);
+        }
+    }, Qt::QueuedConnection);
 }
 
 void GeneralHandler::pause() {
@@ -83,77 +351,285 @@ void GeneralHandler::pause() {
 
 void GeneralHandler::stop() {
     stopped.store(true);
+    if (controlThread->isRunning()) {
+        QMetaObject::invokeMethod(control, [this]() {
+            timer->stop();
+        }, Qt::QueuedConnection);
+    }
 }
 
 void GeneralHandler::resume() {
     paused.store(false);
 }
 
-void GeneralHandler::startTasks(const QList<QFileInfo>& files) {
-    const int maxTaskInMoment = std::max(1, pool->maxThreadCount() * 4);
-    auto activeCount = std::make_shared<std::atomic<int>>(0);
+void GeneralHandler::setKeyFormat(const nXorKey::KeyFormat& format) {
+    nextOptions.keyFormat = format;
+}
+
+void GeneralHandler::setTransformOptions(const nTransform::TransformOptions& options) {
+    nextOptions.transformOptions = options;
+}
 
-    std::thread([this, files, maxTaskInMoment, activeCount]() {
-        size_t idx = 0;
-        const size_t total = files.size();
+void GeneralHandler::setBatchCommit(bool enabled, const nCommitStage::CommitOptions& options) {
+    nextOptions.isBatchCommit = enabled;
+    nextOptions.commitOptions = options;
+}
 
-        while (idx < total) {
-            if (stopped.load()) {
-                if (mode.mode == ModeTreatment::TimerTreatment) {
-                    timer->stop();
-                }
-                break;
+void GeneralHandler::setHoleMode(nLocalHandler::HoleMode holeMode) {
+    nextOptions.holeMode = holeMode;
+}
+
+void GeneralHandler::setContainerOutput(bool enabled, const nContainer::ContainerOptions& options) {
+    nextOptions.isContainerOutput = enabled;
+    nextOptions.containerOptions = options;
+}
+
+void GeneralHandler::setClaiming(bool enabled, const nClaimDirectory::ClaimOptions& options) {
+    nextOptions.isClaiming = enabled;
+    nextOptions.claimOptions = options;
+}
+
+std::shared_ptr<const nTransform::Transform> GeneralHandler::transformForFile(const QFileInfo& file) const {
+    auto byName = transformsByMask.value(file.fileName());
+    if (byName) {
+        return byName;
+    }
+    auto bySuffix = transformsByMask.value(file.suffix());
+    return bySuffix ? bySuffix : transform;
+}
+
+int GeneralHandler::classForFile(const QFileInfo& file) const {
+    auto byName = classByMask.constFind(file.fileName());
+    if (byName != classByMask.constEnd()) {
+        return byName.value();
+    }
+    return classByMask.value(file.suffix(), 0);
+}
+
+void GeneralHandler::startTasks(std::shared_ptr<const nJobTable::JobTable> jobs) {
+    auto cycle = std::make_shared<CycleState>();
+    cycle->jobs = jobs;
+    cycle->settings = CycleSettings{conflict, isNeedDelete, options.holeMode, mode, dirOutputFolder, priorityClasses, nameAllocator, claims};
+    if (cycle->settings.conflict == nLocalHandler::ConflictMode::AddCounter) {
+        cycle->settings.nameAllocator->snapshot();
+    }
+    if (options.isBatchCommit) {
+        cycle->commitStage = std::make_shared<nCommitStage::CommitStage>(options.commitOptions);
+        cycle->commitStage->setNameAllocator(cycle->settings.nameAllocator);
+        connect(cycle->commitStage.get(), &nCommitStage::CommitStage::logMessage, this, &GeneralHandler::sendLog, Qt::QueuedConnection);
+    }
+    if (options.isContainerOutput) {
+        cycle->segmentWriter = std::make_shared<nContainer::SegmentWriter>(cycle->settings.folder, options.containerOptions);
+    }
+    cycle->throughputModel = std::make_shared<nThroughputModel::ThroughputModel>(*jobs);
+    cycle->observer = std::make_shared<CycleObserver>(this, jobs, cycle->throughputModel, cycle->settings.claims, inFlight,
+                                                      cycle->commitStage != nullptr, [this]() {
+        QMutexLocker locker(&dispatchMutex);
+        isTaskFinished = true;
+        inboxChanged.wakeAll();
+    });
+    if (cycle->commitStage) {
+        CycleObserver* observer = cycle->observer.get();
+        connect(cycle->commitStage.get(), &nCommitStage::CommitStage::published, cycle->commitStage.get(),
+                [observer](const QString& sourcePath) {
+            observer->filePublished(sourcePath);
+        }, Qt::DirectConnection);
+    }
+    cycle->pending = jobs->size();
+    cycle->estimateTimer.start();
+    {
+        QMutexLocker locker(&inFlight->mutex);
+        for (int job = 0; job < jobs->size(); ++job) {
+            inFlight->paths.insert(jobs->fileInfo(job).absoluteFilePath());
+        }
+    }
+
+    QMutexLocker locker(&dispatchMutex);
+    inbox.append(cycle);
+    inboxChanged.wakeAll();
+}
+
+void GeneralHandler::runDispatcher() {
+    nDispatchQueue::DispatchQueue queue;
+    QHash<quint64, std::shared_ptr<CycleState>> cycles;
+    const auto runningTasks = [&cycles]() {
+        int count = 0;
+        for (const auto& cycle : cycles) {
+            count += cycle->observer->activeCount.load();
+        }
+        return count;
+    };
+
+    for (;;) {
+        bool isLeaving = false;
+        {
+            QMutexLocker locker(&dispatchMutex);
+            while (inbox.isEmpty() && cycles.isEmpty() && !isQuitting) {
+                inboxChanged.wait(&dispatchMutex);
             }
-            while (paused.load()) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(100));
-                if (stopped.load()) break;
+            if (inbox.isEmpty() && cycles.isEmpty()) {
+                return;
             }
-
-            if (activeCount->load() >= maxTaskInMoment) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(10));
-                continue;
+            // The files of a new scan join the queue at once, an urgent one does not wait for the files found before it
+            for (const auto& cycle : inbox) {
+                queue.push(cycle->jobs->cycle(), *cycle->jobs, cycle->settings.classes);
+                cycles.insert(cycle->jobs->cycle(), cycle);
             }
+            inbox.clear();
+            isLeaving = isQuitting;
+        }
 
-            const QFileInfo file = files.at(idx++);
-            auto* task = new nLocalHandler::LocalHandler(conflict, key, file, dirOutputFolder, isNeedDelete, paused, stopped);
-            task->setAutoDelete(true);
+        const qint64 now = QDateTime::currentMSecsSinceEpoch();
+        if (stopped.load() || isLeaving) {
+            // The files that were not started are given back to the next start and to the other instances
+            while (!queue.isEmpty()) {
+                const nDispatchQueue::DispatchQueue::Item item = queue.next(now);
+                CycleState& cycle = *cycles.value(item.batch);
+                --cycle.pending;
+                const QString path = cycle.jobs->fileInfo(item.job).absoluteFilePath();
+                if (cycle.settings.claims) {
+                    cycle.settings.claims->abandon(path);
+                }
+                QMutexLocker locker(&inFlight->mutex);
+                inFlight->paths.remove(path);
+            }
+        } else if (!paused.load() && !queue.isEmpty() && runningTasks() < std::max(1, pool->maxThreadCount() * 4)) {
+            const nDispatchQueue::DispatchQueue::Item item = queue.next(now);
+            const std::shared_ptr<CycleState> cycle = cycles.value(item.batch);
+            const CycleSettings& settings = cycle->settings;
+            --cycle->pending;
+            latencyStats->add(cycle->jobs->at(item.job).priorityClass, now - cycle->jobs->at(item.job).arrival);
 
-            connect(task, &nLocalHandler::LocalHandler::logMessage, this, &GeneralHandler::sendLog, Qt::QueuedConnection);
-            connect(task, &nLocalHandler::LocalHandler::processStatus, this, &GeneralHandler::sendStatusFile, Qt::QueuedConnection);
+            // A task is a plain value run as a function: no QObject and no signal connections per file
+            nLocalHandler::FileTask task(settings.conflict, cycle->jobs, item.job, settings.isNeedDelete, paused, stopped);
+            task.setCommitStage(cycle->commitStage);
+            task.setNameAllocator(settings.nameAllocator);
+            task.setHoleMode(settings.holeMode);
+            task.setSegmentWriter(cycle->segmentWriter);
+            task.setThroughputModel(cycle->throughputModel);
+            task.setClaimDirectory(settings.claims);
+            task.setObserver(cycle->observer.get());
 
-            activeCount->fetch_add(1);
-            connect(task, &nLocalHandler::LocalHandler::finished, this, [activeCount, this](nLocalHandler::LocalHandler*) {
-                activeCount->fetch_sub(1);
-            }, Qt::QueuedConnection);
+            cycle->observer->activeCount.fetch_add(1);
+            pool->start([task = std::move(task), observer = cycle->observer]() mutable {
+                task.run();
+            });
+            continue;
+        }
 
-            pool->start(task);
+        for (auto it = cycles.begin(); it != cycles.end();) {
+            CycleState& cycle = *it.value();
+            if (cycle.pending == 0 && cycle.observer->activeCount.load() == 0) {
+                finishCycle(cycle);
+                it = cycles.erase(it);
+                continue;
+            }
+            if (cycle.estimateTimer.elapsed() >= 500) {
+                cycle.estimateTimer.restart();
+                emit estimate(cycle.throughputModel->estimate());
+            }
+            ++it;
         }
+        if (!cycles.isEmpty()) {
+            // Waits for a new scan or the end of a task, the timeout only paces the estimates and the pause
+            QMutexLocker locker(&dispatchMutex);
+            if (inbox.isEmpty() && !isTaskFinished) {
+                inboxChanged.wait(&dispatchMutex, 10);
+            }
+            isTaskFinished = false;
+        }
+    }
+}
+
+void GeneralHandler::finishCycle(CycleState& cycle) {
+    emit estimate(cycle.throughputModel->estimate());
+
+    if (cycle.commitStage) {
+        cycle.commitStage->flush();
+    }
+    bool isSealed = true;
+    if (cycle.segmentWriter && !cycle.segmentWriter->close()) {
+        isSealed = false;
+        emit sendLog("Failed to complete the segment in " + cycle.settings.folder.absolutePath());
+    }
+    // Only now the scans may see the sources again and the claims become done markers
+    cycle.observer->settleWaiting(isSealed);
 
-        while (activeCount->load() > 0) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    if (cycle.settings.mode.mode == ModeTreatment::TimerTreatment) {
+        for (const auto& latency : latencyStats->summary()) {
+            const QString name = latency.priorityClass < cycle.settings.classes.size() ? cycle.settings.classes.at(latency.priorityClass).name : QString();
+            emit sendLog(QString("Queue latency of %1: p50 %2 ms, p95 %3 ms, p99 %4 ms, max %5 ms (%6 files)")
+                         .arg(name).arg(latency.p50).arg(latency.p95).arg(latency.p99).arg(latency.max)
+                         .arg(static_cast<qint64>(latency.count)));
         }
+    }
 
-        QMetaObject::invokeMethod(this, [this]() {
-            cycleInProgress = false;
-        }, Qt::QueuedConnection);
-    }).detach();
+    QMetaObject::invokeMethod(control, [this]() {
+        emit cycleFinished();
+    }, Qt::QueuedConnection);
 }
 
 void GeneralHandler::findFilesByMask() {
-    if (cycleInProgress) return;
-    cycleInProgress = true;
+    if (claims) {
+        // Locks left by a previous run of this instance and by dead instances do not hide files from this scan
+        const int recovered = claims->recoverExpired();
+        if (recovered > 0) {
+            emit sendLog(QString("Recovered %1 files from expired leases").arg(recovered));
+        }
+    }
 
-    QList<QFileInfo> files;
-    for (const QFileInfo& file : dirOutputFolder.entryInfoList(QDir::Files)) {
+    auto jobs = std::make_shared<nJobTable::JobTable>(++lastCycle);
+    const quint32 outputFolderId = jobs->addFolder(dirOutputFolder);
+    const QList<QFileInfo> entries = dirOutputFolder.entryInfoList(QDir::Files);
+    jobs->reserve(entries.size());
+    // A file seen for the first time arrived after the previous scan, but not before it was last modified
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    QHash<QString, qint64> seen;
+    for (const QFileInfo& file : entries) {
         if (masks.contains(file.suffix()) || masks.contains(file.fileName())) {
-            files.append(file);
+            qint64 arrival = arrivals.value(file.fileName(), 0);
+            if (arrival == 0) {
+                arrival = qBound(lastScan, file.lastModified().toMSecsSinceEpoch(), now);
+            }
+            seen.insert(file.fileName(), arrival);
+
+            {
+                // Queued and running files of the previous scans are already in the dispatch queue
+                QMutexLocker locker(&inFlight->mutex);
+                if (inFlight->paths.contains(file.absoluteFilePath())) {
+                    continue;
+                }
+            }
+            if (claims && !claims->claim(file)) {
+                continue;
+            }
+            jobs->add(file, outputFolderId, jobs->addTransform(transformForFile(file)), classForFile(file), arrival);
         }
     }
+    arrivals.swap(seen);
+    lastScan = now;
 
-    emit findFiles(files);
-    emit sendLog(QString("Found %1 files").arg(files.size()));
+    if (jobs->size() == 0) {
+        // The view keeps the files of the running cycles. Only a single start needs the empty cycle for its cycleFinished
+        if (mode.mode == ModeTreatment::OneTimeTreatment) {
+            emit sendLog("Found 0 files");
+            startTasks(jobs);
+        }
+        return;
+    }
+    emit findFiles(jobs);
+    emit sendLog(QString("Found %1 files").arg(jobs->size()));
+
+    const QList<nThroughputModel::DeviceTotal> totals = nThroughputModel::preflight(*jobs);
+    for (const auto& total : totals) {
+        emit sendLog(QString("Device %1 (%2): %3 files, %4 MB to read, %5 MB to write")
+                     .arg(total.device, total.rootPath).arg(total.files)
+                     .arg(total.readBytes / (1024.0 * 1024.0), 0, 'f', 1)
+                     .arg(total.writeBytes / (1024.0 * 1024.0), 0, 'f', 1));
+    }
+    emit preflight(totals);
 
-    startTasks(files);
+    startTasks(jobs);
 }
 
 }
@@ -12,9 +12,24 @@
 #include <QList>
 #include <QThreadPool>
 #include <QTimer>
+#include <QThread>
+#include <QMetaType>
 #include <thread>
 #include <chrono>
 #include "localhandler.h"
+#include "xorkey.h"
+#include "transform.h"
+#include "commitstage.h"
+#include "nameallocator.h"
+#include "jobtable.h"
+#include "container.h"
+#include "claimdirectory.h"
+#include "dispatchqueue.h"
+#include "throughputmodel.h"
+#include <QHash>
+#include <QSet>
+#include <QMutex>
+#include <QWaitCondition>
 
 /**
  * @namespace nGeneralHandler
@@ -51,14 +66,91 @@ struct CommonModeTreatment {
     ModeTreatment mode;
 };
 
+/**
+ * @struct CycleSettings
+ * @brief Parameters of the start that found the files of a cycle. getInputParams changes the members of GeneralHandler
+ * on the control thread at any restart, so the dispatcher and the tasks of a cycle only use this copy
+ */
+struct CycleSettings {
+    nLocalHandler::ConflictMode conflict;
+    bool isNeedDelete;
+    nLocalHandler::HoleMode holeMode;
+    CommonModeTreatment mode;
+    QDir folder;
+    QList<nDispatchQueue::PriorityClass> classes;
+    std::shared_ptr<nNameAllocator::NameAllocator> nameAllocator;
+    std::shared_ptr<nClaimDirectory::ClaimDirectory> claims;
+};
+
+/**
+ * @struct InFlightFiles
+ * @brief Absolute paths of the found files that are queued or being processed. The scans skip them,
+ * a file is removed when its result is published or it is given back at a stop or on an error
+ */
+struct InFlightFiles {
+    QMutex mutex;
+    QSet<QString> paths;
+};
+
+/**
+ * @struct StartOptions
+ * @brief Options set by the setters of GeneralHandler. The setters change the copy of the caller's thread,
+ * start passes it to the control thread, so a running start never sees a half-set value
+ */
+struct StartOptions {
+    nXorKey::KeyFormat keyFormat;
+    nTransform::TransformOptions transformOptions;
+    bool isBatchCommit = false;
+    nCommitStage::CommitOptions commitOptions;
+    nLocalHandler::HoleMode holeMode = nLocalHandler::HoleMode::KeyPattern;
+    bool isContainerOutput = false;
+    nContainer::ContainerOptions containerOptions;
+    bool isClaiming = false;
+    nClaimDirectory::ClaimOptions claimOptions;
+};
+
+/**
+ * @struct CycleState
+ * @brief Jobs of one scan and everything their tasks share, owned by the dispatcher until the cycle is finished
+ */
+struct CycleState;
+
 /**
  * @class GeneralHandler
- * @brief The class responsible for processing input parameters. Contains a child thread that works with QThreadPool
+ * @brief The class responsible for processing input parameters. The scan, the scheduling and the timer run on its own
+ * control thread, the UI only receives signals. The dispatcher thread lives as long as the handler and keeps one queue
+ * of the files of all scans, so a scan during a long cycle adds its files to the running work
  */
 class GeneralHandler : public QObject {
     Q_OBJECT
 
-    QString key;
+    std::shared_ptr<const nTransform::Transform> transform;
+    QHash<QString, std::shared_ptr<const nTransform::Transform>> transformsByMask;
+    QList<nDispatchQueue::PriorityClass> priorityClasses;
+    QHash<QString, int> classByMask;
+    /**
+     * @brief arrivals Estimated arrival time of each matching file name seen by the last scan
+     */
+    QHash<QString, qint64> arrivals;
+    qint64 lastScan = 0;
+    /**
+     * @brief lastCycle Number of the last cycle, it identifies the job table and the reports of the cycle
+     */
+    quint64 lastCycle = 0;
+    std::shared_ptr<nDispatchQueue::LatencyStats> latencyStats;
+    /**
+     * @brief nextOptions Options for the next start, only used on the thread that calls the setters and start
+     */
+    StartOptions nextOptions;
+    /**
+     * @brief options Options of the running start, only used on the control thread
+     */
+    StartOptions options;
+    std::shared_ptr<nNameAllocator::NameAllocator> nameAllocator;
+    /**
+     * @brief claims Claims of this instance in the input folder, only if claiming is enabled
+     */
+    std::shared_ptr<nClaimDirectory::ClaimDirectory> claims;
     bool isNeedDelete;
     nLocalHandler::ConflictMode conflict;
     CommonModeTreatment mode;
@@ -67,12 +159,50 @@ class GeneralHandler : public QObject {
     QStringList masks;
     std::shared_ptr<QList<IncorrectInput>> incorrectParams;
     QThreadPool* pool;
+    /**
+     * @brief controlThread Event loop of the scan, the scheduling and the timer. It does not depend on the UI thread
+     */
+    QThread* controlThread;
+    /**
+     * @brief control Context object living in controlThread
+     */
+    QObject* control;
     QTimer* timer;
-    int timerValue;
-    std::atomic<int> activeTasks;
-    std::atomic<bool> paused;
-    std::atomic<bool> stopped;
-    bool cycleInProgress;
+    /**
+     * @brief heartbeatTimer Renews the lease of the claims independently of the cycles
+     */
+    QTimer* heartbeatTimer;
+    /**
+     * @brief dispatcher Thread that submits the tasks of all cycles to the pool in the order of the dispatch queue
+     */
+    std::thread dispatcher;
+    /**
+     * @brief dispatchMutex Guards inbox, isQuitting and isTaskFinished
+     */
+    QMutex dispatchMutex;
+    QWaitCondition inboxChanged;
+    /**
+     * @brief inbox Cycles found by the scans and not taken by the dispatcher yet
+     */
+    QList<std::shared_ptr<CycleState>> inbox;
+    bool isQuitting = false;
+    /**
+     * @brief isTaskFinished A task has ended since the dispatcher last waited, so a slot in the pool may be free
+     */
+    bool isTaskFinished = false;
+    std::shared_ptr<InFlightFiles> inFlight;
+    std::atomic<bool> paused{false};
+    std::atomic<bool> stopped{false};
+
+    /**
+     * @brief runDispatcher Body of the dispatcher thread: merges the new cycles into the queue, starts the jobs
+     * and finishes the cycles whose tasks are all done. Returns after the destructor asks it to quit
+     */
+    void runDispatcher();
+    /**
+     * @brief finishCycle Publishes the results of a cycle whose tasks are all done and reports its end
+     */
+    void finishCycle(CycleState& cycle);
 
 public:
     /**
@@ -81,14 +211,21 @@ public:
      */
     GeneralHandler(QObject *parent = nullptr);
     /**
-     * @brief start Main function of the class, responsible for starting the logic
+     * @brief Destructor. Stops the timer and the control thread
+     */
+    ~GeneralHandler() override;
+    /**
+     * @brief start Main function of the class, responsible for starting the logic. Uses the options set by the setters
+     * before the call, the setters and start must be called on the same thread
      * @param key Key is 8 bytes in HEX format. It must begin with the following format: 0x
      * @param isNeedDelete Flag that indicating whether the original files should be deleted
      * @param conflict Parameter that specifies what names the source files should have
      * @param mode Determines the program's operating mode: single run or timer
      * @param pathOutputFolder Specifies from which folder the files will be taken
      * @param pathInputFolder Specifies which folder to write files to
-     * @param mask Indicates which files to take, two recording options: *.txt;(also *.txt,) or if you want specific file: fileName.txt
+     * @param mask Indicates which files to take, two recording options: *.txt;(also *.txt,) or if you want specific file: fileName.txt.
+     * A mask may have its own key: *.bin:0x1122334455667788 and a priority with an optional target latency in ms:
+     * *.log@0, *.bin@10/2000, *.bin:0x1122334455667788@10
      */
     void start(const QString& key, const bool& isNeedDelete,
                const nLocalHandler::ConflictMode& conflict, const CommonModeTreatment& mode,
@@ -103,9 +240,44 @@ public:
      */
     void resume();
     /**
-     * @brief Completely stops working. IMPORTANT: Files that have not been completely modified will be incomplete
+     * @brief Completely stops working and stops the timer. The files that were not started are left for the next start.
+     * IMPORTANT: Files that have not been completely modified will be incomplete
      */
     void stop();
+    /**
+     * @brief setKeyFormat Sets how the key will be interpreted at the next start
+     * @param format Byte order of the key and compatibility flag for files written by older versions
+     */
+    void setKeyFormat(const nXorKey::KeyFormat& format);
+    /**
+     * @brief setTransformOptions Selects the transformation that will be used at the next start
+     * @param options Fixed XOR or key stream and its parameters
+     */
+    void setTransformOptions(const nTransform::TransformOptions& options);
+    /**
+     * @brief setBatchCommit Enables durable publication of the results in batches at the next start
+     * @param enabled If false, each task renames and deletes its files itself without flushing them to disk
+     * @param options Size of the batch and the way to flush the data
+     */
+    void setBatchCommit(bool enabled, const nCommitStage::CommitOptions& options = nCommitStage::CommitOptions());
+    /**
+     * @brief setHoleMode Sets what to do with holes of sparse files at the next start
+     * @param holeMode Write the transformed zeros or keep the holes
+     */
+    void setHoleMode(nLocalHandler::HoleMode holeMode);
+    /**
+     * @brief setContainerOutput Enables packing of small files into segment files at the next start
+     * @param enabled If false, every file is written separately
+     * @param options Threshold of a small file and size of a segment
+     */
+    void setContainerOutput(bool enabled, const nContainer::ContainerOptions& options = nContainer::ContainerOptions());
+    /**
+     * @brief setClaiming Enables sharing of the input folder with other instances at the next start.
+     * Each found file is claimed before processing, so it is processed by one instance only
+     * @param enabled If false, all found files are processed
+     * @param options Name of the instance and lease timeout
+     */
+    void setClaiming(bool enabled, const nClaimDirectory::ClaimOptions& options = nClaimDirectory::ClaimOptions());
 
 protected:
     /**
@@ -116,22 +288,37 @@ protected:
      * @param mode Determines the program's operating mode: single run or timer
      * @param pathOutputFolder Specifies from which folder the files will be taken
      * @param pathInputFolder Specifies which folder to write files to
-     * @param mask Indicates which files to take, two recording options: *.txt;(also *.txt,) or if you want specific file: fileName.txt
+     * @param mask Indicates which files to take, two recording options: *.txt;(also *.txt,) or if you want specific file: fileName.txt.
+     * A mask may have its own key: *.bin:0x1122334455667788 and a priority with an optional target latency in ms:
+     * *.log@0, *.bin@10/2000, *.bin:0x1122334455667788@10
+     * @param options Options set before the start, they are applied only if the parameters are correct
      * @return returns True if there are invalid parameters else false
      */
     bool getInputParams(const QString& key, const bool& isNeedDelete,
                         const nLocalHandler::ConflictMode& conflict, const CommonModeTreatment& mode,
                         const QString& pathOutputFolder, const QString& pathInputFolder,
-                        const QString& mask);
+                        const QString& mask, const StartOptions& options = StartOptions());
     /**
      * @brief Finds all files matching the mask
      */
     void findFilesByMask();
     /**
-     * @brief startTasks Starts a child thread that creates tasks for each of the individual files that match the mask
-     * @param files Satisfying the mask passed by the user
+     * @brief transformForFile Selects the transformation for the file: the key of the mask by file name,
+     * then by extension, otherwise the common key
+     * @param file File that matches the mask
+     */
+    std::shared_ptr<const nTransform::Transform> transformForFile(const QFileInfo& file) const;
+    /**
+     * @brief classForFile Selects the priority class for the file in the same way as transformForFile
+     * @param file File that matches the mask
+     * @return Index in the list of priority classes
      */
-    virtual void startTasks(const QList<QFileInfo>& files);
+    int classForFile(const QFileInfo& file) const;
+    /**
+     * @brief startTasks Passes the files of the scan to the dispatcher, which creates a task for each of them
+     * @param jobs Table of the files satisfying the mask passed by the user
+     */
+    virtual void startTasks(std::shared_ptr<const nJobTable::JobTable> jobs);
 
 signals:
     /**
@@ -146,18 +333,35 @@ signals:
     void sendLog(const QString& message);
     /**
      * @brief sendStatusFile Forwards information from a child thread
-     * @param file The file being worked on
+     * @param cycle Number of the cycle, JobTable::cycle of the table passed by findFiles
+     * @param job Index of the file being worked on in that table
      * @param percent Rate of work completed on a file
      */
-    void sendStatusFile(const QFileInfo& file, const size_t& percent);
+    void sendStatusFile(quint64 cycle, int job, const size_t& percent);
     /**
      * @brief findFiles Passes information to the UI so it can display progress on files
-     * @param files All found files that match the mask specified by the user
+     * @param jobs Table of all found files that match the mask specified by the user. Not sent for a scan that found nothing
      */
-    void findFiles(const QList<QFileInfo>& files);
+    void findFiles(std::shared_ptr<const nJobTable::JobTable> jobs);
+    /**
+     * @brief cycleFinished All files found by one scan have been processed and the results published.
+     * The cycles of the timer mode may overlap, each of them sends it once. A timer scan that found nothing starts no cycle
+     */
+    void cycleFinished();
+    /**
+     * @brief preflight Bytes that the cycle will read and write per device, sent before its tasks start
+     * @param totals One entry per device of the input and output folders
+     */
+    void preflight(const QList<nThroughputModel::DeviceTotal>& totals);
+    /**
+     * @brief estimate Progress of the running cycle in bytes and its remaining time, sent about twice a second and at its end
+     */
+    void estimate(const nThroughputModel::Estimate& estimate);
 
 };
 
 }
 
+Q_DECLARE_METATYPE(std::shared_ptr<QList<nGeneralHandler::IncorrectInput>>)
+
 #endif // GENERALHANDLER_H
@@ -0,0 +1,67 @@
+#include "jobtable.h"
+#include <QDateTime>
+
+namespace nJobTable {
+
+quint32 JobTable::addFolder(const QDir& folder) {
+    const QString path = folder.absolutePath();
+    auto it = folderIds.constFind(path);
+    if (it != folderIds.constEnd()) {
+        return it.value();
+    }
+    const quint32 id = static_cast<quint32>(folders.size());
+    folders.append(path);
+    folderIds.insert(path, id);
+    return id;
+}
+
+quint32 JobTable::addTransform(const std::shared_ptr<const nTransform::Transform>& transform) {
+    auto it = transformIds.constFind(transform.get());
+    if (it != transformIds.constEnd()) {
+        return it.value();
+    }
+    const quint32 id = static_cast<quint32>(transforms.size());
+    transforms.append(transform);
+    transformIds.insert(transform.get(), id);
+    return id;
+}
+
+int JobTable::add(const QFileInfo& file, quint32 outputFolderId, quint32 transformId, quint32 priorityClass, qint64 arrival) {
+    const QByteArray name = file.fileName().toUtf8();
+    Job job;
+    job.nameOffset = static_cast<quint32>(names.size());
+    job.nameLength = static_cast<quint32>(name.size());
+    job.inputFolderId = addFolder(file.absoluteDir());
+    job.outputFolderId = outputFolderId;
+    job.transformId = transformId;
+    job.priorityClass = priorityClass;
+    job.size = file.size();
+    job.modified = file.lastModified().toMSecsSinceEpoch();
+    job.arrival = arrival != 0 ? arrival : job.modified;
+    names.append(name);
+    jobs.push_back(job);
+    return static_cast<int>(jobs.size()) - 1;
+}
+
+void JobTable::reserve(int count) {
+    jobs.reserve(count);
+}
+
+QString JobTable::fileName(int index) const {
+    const Job& job = jobs[index];
+    return QString::fromUtf8(names.constData() + job.nameOffset, job.nameLength);
+}
+
+QFileInfo JobTable::fileInfo(int index) const {
+    return QFileInfo(QDir(folders.at(jobs[index].inputFolderId)), fileName(index));
+}
+
+QDir JobTable::outputFolder(int index) const {
+    return QDir(folders.at(jobs[index].outputFolderId));
+}
+
+const std::shared_ptr<const nTransform::Transform>& JobTable::transform(int index) const {
+    return transforms.at(jobs[index].transformId);
+}
+
+}
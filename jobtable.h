@@ -0,0 +1,124 @@
+/**
+ * @file jobtable.h
+ * @brief Compact descriptions of the files found in one cycle
+ */
+#ifndef JOBTABLE_H
+#define JOBTABLE_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QFileInfo>
+#include <QDir>
+#include <QHash>
+#include <QList>
+#include <QMetaType>
+#include <memory>
+#include <type_traits>
+#include <vector>
+#include "transform.h"
+
+/**
+ * @namespace nJobTable
+ * @brief Contains class JobTable and struct Job
+ */
+namespace nJobTable {
+
+/**
+ * @struct Job
+ * @brief Description of one file. The strings and the transformation are stored once in the table, the job only refers to them
+ */
+struct Job {
+    quint32 nameOffset;
+    quint32 nameLength;
+    quint32 inputFolderId;
+    quint32 outputFolderId;
+    quint32 transformId;
+    quint32 priorityClass;
+    qint64 size;
+    qint64 modified;
+    /**
+     * @brief arrival Time in ms since epoch when the file appeared in the folder as far as the scans can tell
+     */
+    qint64 arrival;
+};
+
+static_assert(std::is_trivially_copyable<Job>::value, "Job must stay a plain record");
+static_assert(sizeof(Job) == 48, "Job must stay six ids and three 64-bit values without padding");
+
+/**
+ * @class JobTable
+ * @brief Contiguous table of jobs. Tasks and progress refer to a job by its index in the table.
+ * File names are kept in one UTF-8 buffer, folders and transformations are interned
+ */
+class JobTable {
+    quint64 cycleId;
+    std::vector<Job> jobs;
+    QByteArray names;
+    QStringList folders;
+    QHash<QString, quint32> folderIds;
+    QList<std::shared_ptr<const nTransform::Transform>> transforms;
+    QHash<const nTransform::Transform*, quint32> transformIds;
+
+public:
+    /**
+     * @brief JobTable Creates an empty table
+     * @param cycle Number of the cycle that found the files. Progress reports carry it, so a receiver can tell a report
+     * of this table from a late report of a previous one
+     */
+    explicit JobTable(quint64 cycle = 0) : cycleId(cycle) {}
+    quint64 cycle() const { return cycleId; }
+    /**
+     * @brief addFolder Returns the id of the folder, adding it on first use
+     * @param folder Input or output folder
+     */
+    quint32 addFolder(const QDir& folder);
+    /**
+     * @brief addTransform Returns the id of the transformation, adding it on first use
+     * @param transform Transformation shared by the jobs
+     */
+    quint32 addTransform(const std::shared_ptr<const nTransform::Transform>& transform);
+    /**
+     * @brief add Adds a job for the file
+     * @param file File that matches the mask
+     * @param outputFolderId Id returned by addFolder
+     * @param transformId Id returned by addTransform
+     * @param priorityClass Index of the priority class of the mask
+     * @param arrival Time of arrival in ms since epoch, 0 means the modification time
+     * @return Index of the job
+     */
+    int add(const QFileInfo& file, quint32 outputFolderId, quint32 transformId, quint32 priorityClass = 0, qint64 arrival = 0);
+    /**
+     * @brief reserve Reserves memory for the expected number of jobs
+     */
+    void reserve(int count);
+
+    int size() const { return static_cast<int>(jobs.size()); }
+    const Job& at(int index) const { return jobs[index]; }
+    /**
+     * @brief folder Path of the folder with the id returned by addFolder
+     */
+    QString folder(quint32 id) const { return folders.at(id); }
+    /**
+     * @brief fileName Name of the input file of the job
+     */
+    QString fileName(int index) const;
+    /**
+     * @brief fileInfo Full information about the input file of the job, built on demand
+     */
+    QFileInfo fileInfo(int index) const;
+    /**
+     * @brief outputFolder Folder for the result of the job
+     */
+    QDir outputFolder(int index) const;
+    /**
+     * @brief transform Transformation of the job
+     */
+    const std::shared_ptr<const nTransform::Transform>& transform(int index) const;
+};
+
+}
+
+Q_DECLARE_METATYPE(std::shared_ptr<const nJobTable::JobTable>)
+
+#endif // JOBTABLE_H
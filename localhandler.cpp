@@ -1,26 +1,75 @@
 #include "localhandler.h"
 #include <iostream>
+#include <algorithm>
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#include <cerrno>
+#endif
 
 namespace nLocalHandler {
 
-LocalHandler::LocalHandler(const ConflictMode& conflict, const QString& key,
-                           const QFileInfo& file, const QDir& folderForOutputFiles,
-                           const bool& isNeedDelete, std::atomic<bool>& paused, std::atomic<bool>& stopped) :
-    QObject(nullptr), QRunnable(), conflict(conflict), key(key), file(file),
-    folderForOutputFiles(folderForOutputFiles), isNeedDelete(isNeedDelete),
-    percent(0), paused(paused), stopped(stopped) {}
+FileTask::FileTask(const ConflictMode& conflict, std::shared_ptr<const nJobTable::JobTable> jobs, int job,
+                   const bool& isNeedDelete, std::atomic<bool>& paused, std::atomic<bool>& stopped) :
+    conflict(conflict), jobs(std::move(jobs)), job(job), isNeedDelete(isNeedDelete),
+    paused(paused), stopped(stopped), percent(0) {}
+
+FileTask::FileTask(const ConflictMode& conflict, const std::shared_ptr<const nTransform::Transform>& transform,
+                   const QFileInfo& file, const QDir& folderForOutputFiles,
+                   const bool& isNeedDelete, std::atomic<bool>& paused, std::atomic<bool>& stopped) :
+    FileTask(conflict, singleJob(file, folderForOutputFiles, transform), 0, isNeedDelete, paused, stopped) {}
+
+std::shared_ptr<const nJobTable::JobTable> FileTask::singleJob(const QFileInfo& file, const QDir& folderForOutputFiles,
+                                                               const std::shared_ptr<const nTransform::Transform>& transform) {
+    auto jobs = std::make_shared<nJobTable::JobTable>();
+    jobs->add(file, jobs->addFolder(folderForOutputFiles), jobs->addTransform(transform));
+    return jobs;
+}
+
+void FileTask::run() {
+    const QFileInfo file = jobs->fileInfo(job);
+    const QDir folderForOutputFiles = jobs->outputFolder(job);
+    const nTransform::Transform& transform = *jobs->transform(job);
+
+    if (throughputModel) {
+        throughputModel->start();
+    }
 
-void LocalHandler::run() {
     QFile input(file.absoluteFilePath());
     if (!input.open(QIODevice::ReadOnly)) {
-        emit logMessage(QString::fromStdString(
+        sendLog(QString::fromStdString(
             "Failed to open file when it was created/overwritten: " + input.fileName().toStdString()
         ));
+        finish(false);
+        return;
+    }
+
+    if (segmentWriter && input.size() <= segmentWriter->maxFileSize()) {
+        QByteArray data = input.readAll();
+        input.close();
+        transform.apply(data.data(), data.size(), 0);
+        // As for a separate output, the source does not stay next to its result when overwriting
+        const bool isRemoved = isNeedDelete || conflict == ConflictMode::Overwrite;
+        const bool isAppended = segmentWriter->append(file.fileName(), data, isRemoved ? file.absoluteFilePath() : QString());
+        if (!isAppended) {
+            sendLog("Failed to append to the segment: " + file.fileName());
+        } else {
+            if (throughputModel) {
+                throughputModel->update(job, data.size());
+            }
+            if (observer) {
+                observer->taskAppended(job);
+            }
+        }
+        sendStatus(100);
+        finish(isAppended);
         return;
     }
 
     QString outputNameFile = file.fileName();
-    if (conflict == ConflictMode::AddCounter) {
+    // A scan may run while the file is written, so an output gets a name that matches the masks only when it is complete
+    if (commitStage || (conflict == ConflictMode::AddCounter && nameAllocator)) {
+        outputNameFile = file.fileName() + ".tmp";
+    } else if (conflict == ConflictMode::AddCounter) {
         int counter = 1;
         while (QFile::exists(folderForOutputFiles.filePath(outputNameFile))) {
             outputNameFile = file.completeBaseName() + "_" + QString::number(counter) + "." + file.suffix();
@@ -32,61 +81,255 @@ void LocalHandler::run() {
 
     QFile output(folderForOutputFiles.filePath(outputNameFile));
     if (!output.open(QIODevice::WriteOnly)) {
-        emit logMessage(QString::fromStdString(
+        sendLog(QString::fromStdString(
             "Failed to open file when it was created/overwritten: " + output.fileName().toStdString()
         ));
+        finish(false);
         return;
     }
 
-    qint64 sizeFile = file.size();
+    const qint64 sizeFile = input.size();
     qint64 processed = 0;
 
-    QByteArray keyBytes = key.toUtf8();
     QElapsedTimer timer;
     timer.start();
 
-    while (!input.atEnd()) {
-        if (stopped.load()) {
-            emit finished(this);
-            input.close();
-            output.close();
-            return;
-        }
+    QByteArray holeBlock;
+    const QList<Extent> extents = dataExtents(input, sizeFile);
+    for (int i = 0; i <= extents.size(); ++i) {
+        const Extent extent = i < extents.size() ? extents.at(i) : Extent{sizeFile, sizeFile};
+
+        while (processed < extent.begin) {
+            if (!waitIfNeeded()) {
+                finish(false);
+                input.close();
+                output.close();
+                return;
+            }
 
-        while (paused.load()) {
-            QThread::msleep(100);
+            const qint64 size = std::min(blockSize, extent.begin - processed);
+            if (holeMode == HoleMode::Preserve) {
+                // Skipped bytes stay a hole in the output, resize below sets the size if the file ends with a hole
+                processed = extent.begin;
+                output.seek(processed);
+            } else {
+                if (holeBlock.size() != blockSize) {
+                    holeBlock = QByteArray(blockSize, '\0');
+                } else {
+                    holeBlock.fill('\0');
+                }
+                transform.apply(holeBlock.data(), size, processed);
+                output.write(holeBlock.constData(), size);
+                processed += size;
+            }
+            reportProgress(processed, sizeFile, timer);
         }
 
-        auto block = input.read(blockSize);
-        for (size_t i = 0; i < block.size(); ++i) {
-            block[i] = block[i] ^ keyBytes[i % 8];
+        if (extent.end > extent.begin) {
+            input.seek(extent.begin);
         }
+        while (processed < extent.end) {
+            if (!waitIfNeeded()) {
+                finish(false);
+                input.close();
+                output.close();
+                return;
+            }
 
-        output.write(block);
-        processed += block.size();
-        size_t newPercent = static_cast<size_t>((double)processed / sizeFile * 100);
-        if (timer.elapsed() > 100 && newPercent != percent) {
-            percent = newPercent;
-            timer.restart();
-            emit processStatus(file, percent);
+            auto block = input.read(std::min(blockSize, extent.end - processed));
+            if (block.isEmpty()) {
+                break;
+            }
+            transform.apply(block.data(), block.size(), processed);
+
+            output.write(block);
+            processed += block.size();
+            reportProgress(processed, sizeFile, timer);
         }
     }
-    emit processStatus(file, 100);
+    if (holeMode == HoleMode::Preserve && output.size() < sizeFile) {
+        output.resize(sizeFile);
+    }
+    sendStatus(100);
     input.close();
     output.close();
 
-    if (isNeedDelete || ConflictMode::Overwrite == conflict && !isNeedDelete) {
+    // In a shared folder the output is marked before it gets a name that matches the masks
+    if (claims && !claims->markDone(output.fileName())) {
+        sendLog("Failed to mark the output as processed: " + output.fileName());
+        output.remove();
+        finish(false);
+        return;
+    }
+
+    if (commitStage) {
+        nCommitStage::PendingFile pendingFile;
+        pendingFile.temporaryPath = output.fileName();
+        pendingFile.sourcePath = file.absoluteFilePath();
+        pendingFile.noReplace = conflict == ConflictMode::AddCounter;
+        if (pendingFile.noReplace) {
+            pendingFile.targetPath = folderForOutputFiles.filePath(file.fileName());
+            pendingFile.inputPath = isNeedDelete ? file.absoluteFilePath() : QString();
+        } else {
+            pendingFile.targetPath = file.absoluteFilePath();
+        }
+        commitStage->add(pendingFile);
+        finish(true);
+        return;
+    }
+
+    if (conflict == ConflictMode::AddCounter && nameAllocator
+        && nameAllocator->publish(output.fileName(), file.fileName()).isEmpty()) {
+        sendLog("Failed to publish " + output.fileName());
+        output.remove();
+        finish(false);
+        return;
+    }
+
+    if (isNeedDelete || (ConflictMode::Overwrite == conflict && !isNeedDelete)) {
         if (!input.remove()) {
-            emit logMessage(QString::fromStdString(
+            sendLog(QString::fromStdString(
                 "Input file was deleteed: " + input.fileName().toStdString()
             ));
         }
     }
 
     if (conflict == ConflictMode::Overwrite && !output.rename(file.absoluteFilePath())) {
-        emit logMessage("Failed to rename " + output.fileName() + " в " + file.fileName());
+        sendLog("Failed to rename " + output.fileName() + " в " + file.fileName());
+        finish(false);
+        return;
+    }
+
+    finish(true);
+}
+
+QList<FileTask::Extent> FileTask::dataExtents(QFile& input, qint64 size) {
+    QList<Extent> extents;
+#ifdef Q_OS_LINUX
+    const int fd = input.handle();
+    qint64 position = 0;
+    while (fd != -1 && position < size) {
+        const off_t dataStart = ::lseek(fd, position, SEEK_DATA);
+        if (dataStart == -1) {
+            if (errno == ENXIO) {
+                // Only a hole up to the end of the file
+                input.seek(0);
+                return extents;
+            }
+            extents.clear();
+            break;
+        }
+        const off_t holeStart = ::lseek(fd, dataStart, SEEK_HOLE);
+        if (holeStart == -1) {
+            extents.clear();
+            break;
+        }
+        extents.append(Extent{dataStart, std::min<qint64>(holeStart, size)});
+        position = holeStart;
+    }
+    input.seek(0);
+    if (!extents.isEmpty() || size == 0) {
+        return extents;
+    }
+#endif
+    extents.append(Extent{0, size});
+    return extents;
+}
+
+bool FileTask::waitIfNeeded() {
+    if (stopped.load()) {
+        return false;
+    }
+    while (paused.load()) {
+        QThread::msleep(100);
+    }
+    return true;
+}
+
+void FileTask::reportProgress(qint64 processed, qint64 sizeFile, QElapsedTimer& timer) {
+    if (throughputModel) {
+        throughputModel->update(job, processed);
+    }
+    size_t newPercent = static_cast<size_t>((double)processed / sizeFile * 100);
+    if (timer.elapsed() > 100 && newPercent != percent) {
+        percent = newPercent;
+        timer.restart();
+        sendStatus(percent);
+    }
+}
+
+void FileTask::sendStatus(size_t percent) {
+    if (observer) {
+        observer->taskProgress(job, percent);
     }
+}
+
+void FileTask::sendLog(const QString& message) {
+    if (observer) {
+        observer->taskLog(message);
+    }
+}
+
+void FileTask::finish(bool isCompleted) {
+    if (observer) {
+        observer->taskFinished(job, isCompleted);
+    }
+}
+
+void FileTask::setObserver(TaskObserver* observer) {
+    this->observer = observer;
+}
+
+void FileTask::setHoleMode(HoleMode holeMode) {
+    this->holeMode = holeMode;
+}
+
+void FileTask::setCommitStage(std::shared_ptr<nCommitStage::CommitStage> commitStage) {
+    this->commitStage = std::move(commitStage);
+}
+
+void FileTask::setNameAllocator(std::shared_ptr<nNameAllocator::NameAllocator> nameAllocator) {
+    this->nameAllocator = std::move(nameAllocator);
+}
+
+void FileTask::setSegmentWriter(std::shared_ptr<nContainer::SegmentWriter> segmentWriter) {
+    this->segmentWriter = std::move(segmentWriter);
+}
+
+void FileTask::setThroughputModel(std::shared_ptr<nThroughputModel::ThroughputModel> throughputModel) {
+    this->throughputModel = std::move(throughputModel);
+}
+
+void FileTask::setClaimDirectory(std::shared_ptr<nClaimDirectory::ClaimDirectory> claims) {
+    this->claims = std::move(claims);
+}
+
+LocalHandler::LocalHandler(const ConflictMode& conflict, std::shared_ptr<const nJobTable::JobTable> jobs, int job,
+                           const bool& isNeedDelete, std::atomic<bool>& paused, std::atomic<bool>& stopped) :
+    QObject(nullptr), QRunnable(), FileTask(conflict, std::move(jobs), job, isNeedDelete, paused, stopped) {
+    setObserver(this);
+}
+
+LocalHandler::LocalHandler(const ConflictMode& conflict, const std::shared_ptr<const nTransform::Transform>& transform,
+                           const QFileInfo& file, const QDir& folderForOutputFiles,
+                           const bool& isNeedDelete, std::atomic<bool>& paused, std::atomic<bool>& stopped) :
+    QObject(nullptr), QRunnable(), FileTask(conflict, transform, file, folderForOutputFiles, isNeedDelete, paused, stopped) {
+    setObserver(this);
+}
+
+void LocalHandler::run() {
+    FileTask::run();
+}
+
+void LocalHandler::taskProgress(int job, size_t percent) {
+    emit processStatus(job, percent);
+}
+
+void LocalHandler::taskLog(const QString& message) {
+    emit logMessage(message);
+}
 
+void LocalHandler::taskFinished(int, bool) {
     emit finished(this);
 }
 
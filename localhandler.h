@@ -11,10 +11,21 @@
 #include <QDir>
 #include <atomic>
 #include <QThread>
+#include <QFile>
+#include <QElapsedTimer>
+#include <QList>
+#include <memory>
+#include "transform.h"
+#include "commitstage.h"
+#include "nameallocator.h"
+#include "jobtable.h"
+#include "container.h"
+#include "throughputmodel.h"
+#include "claimdirectory.h"
 
 /**
  * @namespace nLocalHandler
- * @brief Contains class LocalHandler and enum ConflictMode
+ * @brief Contains classes FileTask, LocalHandler and TaskObserver and enums ConflictMode and HoleMode
  */
 namespace nLocalHandler {
 
@@ -27,52 +38,204 @@ enum class ConflictMode {
     AddCounter
 };
 
-class LocalHandler : public QObject, public QRunnable {
-    Q_OBJECT
+/**
+ * @enum HoleMode
+ * @brief Specifies what to do with holes of sparse files. Holes are never read, in both modes the time depends on the allocated bytes
+ * KeyPattern: the hole is written as the transformed zeros, the result is the same as for a dense file.
+ * Preserve: the hole stays a hole in the output (it is not transformed), so processing the output again restores the source
+ */
+enum class HoleMode {
+    KeyPattern,
+    Preserve
+};
+
+/**
+ * @class TaskObserver
+ * @brief Receives the reports of a FileTask in its worker thread. One observer serves all tasks of a cycle,
+ * so a task does not need its own QObject and signal connections
+ */
+class TaskObserver {
+public:
+    virtual ~TaskObserver() = default;
+    /**
+     * @brief taskProgress Percentage of completion of the job, sent not more often than every 100 ms and once with 100
+     */
+    virtual void taskProgress(int job, size_t percent) = 0;
+    virtual void taskLog(const QString& message) = 0;
+    /**
+     * @brief taskFinished The task has ended, also on errors and stop
+     * @param job Index of the file in the job table
+     * @param isCompleted True if the result has been written (or passed to the commit stage or the segment)
+     */
+    virtual void taskFinished(int job, bool isCompleted) = 0;
+    /**
+     * @brief taskAppended The result of the job is in the current segment, it is published when the segment is sealed.
+     * Reported before taskFinished
+     */
+    virtual void taskAppended(int) {}
+};
 
+/**
+ * @class FileTask
+ * @brief Processing of one file of the job table. It is a plain value that the pool runs as a function,
+ * the reports go to the observer
+ */
+class FileTask {
     ConflictMode conflict;
-    QString key;
-    QFileInfo file;
-    QDir folderForOutputFiles;
+    std::shared_ptr<const nJobTable::JobTable> jobs;
+    int job;
     bool isNeedDelete;
     std::atomic<bool>& paused;
     std::atomic<bool>& stopped;
+    std::shared_ptr<nCommitStage::CommitStage> commitStage;
+    std::shared_ptr<nNameAllocator::NameAllocator> nameAllocator;
+    std::shared_ptr<nContainer::SegmentWriter> segmentWriter;
+    std::shared_ptr<nThroughputModel::ThroughputModel> throughputModel;
+    std::shared_ptr<nClaimDirectory::ClaimDirectory> claims;
+    TaskObserver* observer = nullptr;
+    HoleMode holeMode = HoleMode::KeyPattern;
     size_t percent;
-    static const qint64 blockSize = 1024 * 1024; // 1 MB in bytes
+    static constexpr qint64 blockSize = 1024 * 1024; // 1 MB in bytes
+
+    /**
+     * @struct Extent
+     * @brief Range of allocated data [begin, end) of the input file
+     */
+    struct Extent {
+        qint64 begin;
+        qint64 end;
+    };
+
+    /**
+     * @brief dataExtents Finds allocated ranges of the file with SEEK_DATA/SEEK_HOLE. If it is not supported, the whole file is one range
+     * @param input Opened input file
+     * @param size Size of the file
+     */
+    static QList<Extent> dataExtents(QFile& input, qint64 size);
+    /**
+     * @brief waitIfNeeded Waits while the user has paused the process
+     * @return False if the user pressed stop
+     */
+    bool waitIfNeeded();
+    /**
+     * @brief reportProgress Passes the processed bytes to the throughput model and sends the percentage of completion not more often than every 100 ms
+     */
+    void reportProgress(qint64 processed, qint64 sizeFile, QElapsedTimer& timer);
+    void sendStatus(size_t percent);
+    void sendLog(const QString& message);
+    void finish(bool isCompleted);
+    /**
+     * @brief singleJob Creates a table with one job
+     */
+    static std::shared_ptr<const nJobTable::JobTable> singleJob(const QFileInfo& file, const QDir& folderForOutputFiles,
+                                                                const std::shared_ptr<const nTransform::Transform>& transform);
 public:
     /**
-     * @brief LocalHandler Constructor
+     * @brief FileTask Constructor
+     * @param conflict Parameter that specifies what names the source files should have
+     * @param jobs Table of the files of the cycle, shared between all tasks
+     * @param job Index of the file in the table
+     * @param isNeedDelete Flag that indicating whether the original files should be deleted
+     * @param paused A variable indicating that the user has pressed pause
+     * @param stopped A variable indicating that the user pressed stop
+     */
+    FileTask(const ConflictMode& conflict, std::shared_ptr<const nJobTable::JobTable> jobs, int job,
+             const bool& isNeedDelete, std::atomic<bool>& paused, std::atomic<bool>& stopped);
+    /**
+     * @brief FileTask Constructor for a single file
      * @param conflict Parameter that specifies what names the source files should have
-     * @param key Key is 8 bytes in HEX format. It must begin with the following format: 0x
+     * @param transform Transformation of the data, shared between all tasks
      * @param file File obtained using a mask specified by the user
      * @param folderForOutputFiles Directory where you need to put the modified file
      * @param isNeedDelete Flag that indicating whether the original files should be deleted
      * @param paused A variable indicating that the user has pressed pause
      * @param stopped A variable indicating that the user pressed stop
      */
-    LocalHandler(const ConflictMode& conflict, const QString& key,
-                 const QFileInfo& file, const QDir& folderForOutputFiles,
+    FileTask(const ConflictMode& conflict, const std::shared_ptr<const nTransform::Transform>& transform,
+             const QFileInfo& file, const QDir& folderForOutputFiles,
+             const bool& isNeedDelete, std::atomic<bool>& paused, std::atomic<bool>& stopped);
+    /**
+     * @brief run The key function of the class. Within it, a block-by-block transformation is performed on the transferred file data.
+     * The observer is notified of the progress and of the end (this information is later passed to the UI).
+     */
+    void run();
+    /**
+     * @brief setObserver Sets the receiver of the reports, without it the task reports nothing
+     * @param observer Must stay alive until run returns
+     */
+    void setObserver(TaskObserver* observer);
+    /**
+     * @brief setCommitStage Instead of renaming and deleting files itself, the task passes the written file to the commit stage
+     * @param commitStage Stage shared by all tasks of the cycle
+     */
+    void setCommitStage(std::shared_ptr<nCommitStage::CommitStage> commitStage);
+    /**
+     * @brief setHoleMode Sets what to do with holes of sparse files
+     */
+    void setHoleMode(HoleMode holeMode);
+    /**
+     * @brief setNameAllocator In the AddCounter mode the output is written under a temporary name and published
+     * with the allocator instead of probing the folder
+     * @param nameAllocator Allocator of the output folder shared by all tasks of the cycle
+     */
+    void setNameAllocator(std::shared_ptr<nNameAllocator::NameAllocator> nameAllocator);
+    /**
+     * @brief setSegmentWriter Small files are appended to a segment instead of being written as separate files
+     * @param segmentWriter Writer of the output folder shared by all tasks of the cycle
+     */
+    void setSegmentWriter(std::shared_ptr<nContainer::SegmentWriter> segmentWriter);
+    /**
+     * @brief setThroughputModel The processed bytes of every block are passed to the model of the cycle
+     * @param throughputModel Model shared by all tasks of the cycle
+     */
+    void setThroughputModel(std::shared_ptr<nThroughputModel::ThroughputModel> throughputModel);
+    /**
+     * @brief setClaimDirectory The output gets a done marker before it appears under a name that matches the masks,
+     * so no instance sharing the folder processes it again
+     * @param claims Claims of the shared folder
+     */
+    void setClaimDirectory(std::shared_ptr<nClaimDirectory::ClaimDirectory> claims);
+};
+
+/**
+ * @class LocalHandler
+ * @brief FileTask as a QRunnable that reports through Qt signals, for use outside of GeneralHandler
+ */
+class LocalHandler : public QObject, public QRunnable, public FileTask, private TaskObserver {
+    Q_OBJECT
+
+    void taskProgress(int job, size_t percent) override;
+    void taskLog(const QString& message) override;
+    void taskFinished(int job, bool isCompleted) override;
+
+public:
+    /**
+     * @brief LocalHandler Constructor, see FileTask
+     */
+    LocalHandler(const ConflictMode& conflict, std::shared_ptr<const nJobTable::JobTable> jobs, int job,
                  const bool& isNeedDelete, std::atomic<bool>& paused, std::atomic<bool>& stopped);
     /**
-     * @brief run The key function of the class. Within it, a block-by-block XOR operation is performed on the transferred file data.
-     * The parent thread is also notified of success (this information is later passed to the UI).
+     * @brief LocalHandler Constructor for a single file, see FileTask
      */
+    LocalHandler(const ConflictMode& conflict, const std::shared_ptr<const nTransform::Transform>& transform,
+                 const QFileInfo& file, const QDir& folderForOutputFiles,
+                 const bool& isNeedDelete, std::atomic<bool>& paused, std::atomic<bool>& stopped);
     void run() override;
 
 signals:
     /**
      * @brief processStatus Transmits information about the percentage of completion of work on a file
-     * @param file Information about the input file to be processed
+     * @param job Index of the file in the job table
      * @param percent Rate of work completed on a file
      */
-    void processStatus(const QFileInfo& file, const size_t& percent);
+    void processStatus(int job, const size_t& percent);
     /**
      * @brief logMessage Passes information up
      * @param message Why the message was sent
      */
     void logMessage(const QString& message);
     /**
-     * @brief finished Notifies the parent thread that the work has completed. This is necessary so that subsequent tasks can begin.
+     * @brief finished Notifies the parent thread that the work has completed, also on errors and stop. This is necessary so that subsequent tasks can begin.
      * @param task Pointer to the class object itself
      */
     void finished(LocalHandler* task);
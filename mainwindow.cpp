@@ -17,6 +17,7 @@ MainWindow::MainWindow(QWidget *parent)
     connect(handler.get(), &nGeneralHandler::GeneralHandler::incorrect, this, &MainWindow::problemsWithInputParams);
     connect(handler.get(), &nGeneralHandler::GeneralHandler::sendLog, this, &MainWindow::addLog);
     connect(handler.get(), &nGeneralHandler::GeneralHandler::sendStatusFile, this, &MainWindow::setStatusFile);
+    connect(handler.get(), &nGeneralHandler::GeneralHandler::estimate, this, &MainWindow::setEstimate);
     connect(handler.get(), &nGeneralHandler::GeneralHandler::findFiles, this, &MainWindow::getAllFiles);
     connect(ui->pushButtonOfPause, &QPushButton::clicked, this, [this](){
         if (isPaused) {
@@ -56,6 +57,11 @@ void MainWindow::start() {
     ui->labelOfOutputFolder->setStyleSheet("QLabel { color : black; }");
     ui->labelOfKey->setStyleSheet("QLabel { color : black; }");
     ui->labelOfMaskInputFiles->setStyleSheet("QLabel { color : black; }");
+    ui->listWidgetOfStatusTreatment->clear();
+    ui->progressBarOfTreatment->setValue(0);
+    ui->labelOfEstimate->clear();
+    firstRows.clear();
+    estimates.clear();
     addLog("The process has been started");
     nLocalHandler::ConflictMode conflict = ui->radioButtonOfCounterForOutputFiles->isChecked()
         ? nLocalHandler::ConflictMode::AddCounter : nLocalHandler::ConflictMode::Overwrite;
@@ -65,6 +71,16 @@ void MainWindow::start() {
     } else {
         mode = {static_cast<size_t>(ui->spinBoxOfTimerTreatment->value()), nGeneralHandler::ModeTreatment::TimerTreatment};
     }
+    nXorKey::KeyFormat keyFormat;
+    keyFormat.order = ui->comboBoxOfKeyByteOrder->currentIndex() == 0
+        ? nXorKey::ByteOrder::BigEndian : nXorKey::ByteOrder::LittleEndian;
+    keyFormat.legacy = ui->checkBoxOfLegacyKey->isChecked();
+    handler->setKeyFormat(keyFormat);
+    handler->setBatchCommit(ui->checkBoxOfBatchCommit->isChecked());
+    handler->setHoleMode(ui->checkBoxOfPreserveHoles->isChecked()
+        ? nLocalHandler::HoleMode::Preserve : nLocalHandler::HoleMode::KeyPattern);
+    handler->setContainerOutput(ui->checkBoxOfContainerOutput->isChecked());
+    handler->setClaiming(ui->checkBoxOfSharedFolder->isChecked());
     handler->start(ui->lineEditOfKey->text(), ui->checkBoxOfDeleteFilesAfterProcess->isChecked(),
                    conflict, mode, ui->lineEditOfOutputFolder->text(),
                    ui->lineEditOfInputFolder->text(), ui->lineEditOfMaskInputFiles->text());
@@ -129,35 +145,65 @@ void MainWindow::problemsWithInputParams(std::shared_ptr<QList<nGeneralHandler::
     }
 }
 
-void MainWindow::setStatusFile(const QFileInfo& file, const size_t& percent) {
-    progressByFile[file.fileName()] = percent;
-    size_t sum = 0;
-    for (auto& p : progressByFile) sum += p.second;
-    size_t total = progressByFile.empty() ? 0 : sum / progressByFile.size();
+void MainWindow::setStatusFile(quint64 cycle, int job, const size_t& percent) {
+    // Reports are queued, the last ones of a previous start can arrive after the list of the next one
+    const auto firstRow = firstRows.constFind(cycle);
+    if (firstRow == firstRows.constEnd() || job < 0) {
+        return;
+    }
+    QListWidgetItem *item = ui->listWidgetOfStatusTreatment->item(firstRow.value() + job);
+    if (!item) {
+        return;
+    }
+    item->setText(QString("%1 — %2%").arg(item->data(Qt::UserRole).toString()).arg(percent));
+}
 
-    ui->progressBarOfTreatment->setValue(total);
+void MainWindow::setEstimate(const nThroughputModel::Estimate& estimate) {
+    if (!firstRows.contains(estimate.cycle)) {
+        return;
+    }
+    estimates.insert(estimate.cycle, estimate);
+    showEstimate();
+}
 
-    for (int i = 0; i < ui->listWidgetOfStatusTreatment->count(); ++i) {
-        QListWidgetItem *item = ui->listWidgetOfStatusTreatment->item(i);
-        if (item->data(Qt::UserRole).toString() == file.fileName()) {
-            item->setText(QString("%1 — %2%").arg(file.fileName()).arg(percent));
-            return;
-        }
+void MainWindow::showEstimate() {
+    // The workers of different cycles are different tasks, so their rates add up
+    nThroughputModel::Estimate total;
+    for (const nThroughputModel::Estimate& estimate : estimates) {
+        total.processedBytes += estimate.processedBytes;
+        total.totalBytes += estimate.totalBytes;
+        total.bytesPerSecond += estimate.bytesPerSecond;
+    }
+    // Bytes instead of the average of the file percentages: one large file is not worth the same as one small file
+    ui->progressBarOfTreatment->setValue(total.totalBytes > 0 ? static_cast<int>(total.processedBytes * 100 / total.totalBytes) : 100);
+    if (total.processedBytes >= total.totalBytes) {
+        ui->labelOfEstimate->clear();
+    } else if (total.bytesPerSecond <= 0) {
+        ui->labelOfEstimate->setText("Estimating the remaining time...");
+    } else {
+        total.remainingMs = static_cast<qint64>((total.totalBytes - total.processedBytes) / total.bytesPerSecond * 1000);
+        ui->labelOfEstimate->setText(QString("%1 MB/s, about %2 s left")
+                                     .arg(total.bytesPerSecond / (1024.0 * 1024.0), 0, 'f', 1)
+                                     .arg((total.remainingMs + 999) / 1000));
     }
 }
 
-void MainWindow::getAllFiles(const QList<QFileInfo>& files) {
-    ui->listWidgetOfStatusTreatment->clear();
-    progressByFile.clear();
-    ui->progressBarOfTreatment->setValue(0);
-    for (const QFileInfo &file : files) {
-        progressByFile[file.fileName()] = 0;
+void MainWindow::getAllFiles(std::shared_ptr<const nJobTable::JobTable> jobs) {
+    firstRows.insert(jobs->cycle(), ui->listWidgetOfStatusTreatment->count());
+    nThroughputModel::Estimate estimate;
+    estimate.cycle = jobs->cycle();
+    for (int job = 0; job < jobs->size(); ++job) {
+        const QString fileName = jobs->fileName(job);
         QListWidgetItem *item = new QListWidgetItem(
-            QString("%1 — 0%").arg(file.fileName()),
+            QString("%1 — 0%").arg(fileName),
             ui->listWidgetOfStatusTreatment
         );
-        item->setData(Qt::UserRole, file.fileName());
+        item->setData(Qt::UserRole, fileName);
+        estimate.totalBytes += static_cast<quint64>(jobs->at(job).size);
     }
+    // Until its first estimate arrives the new cycle counts as not started
+    estimates.insert(estimate.cycle, estimate);
+    showEstimate();
 }
 
 MainWindow::~MainWindow()
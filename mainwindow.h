@@ -47,7 +47,20 @@ private:
     Ui::MainWindow *ui;
     std::shared_ptr<nGeneralHandler::GeneralHandler> handler;
     bool isPaused;
-    std::unordered_map<QString, size_t> progressByFile;
+    /**
+     * @brief firstRows Row of the first file of each cycle of the current start in the list.
+     * Reports of other cycles are late reports of a previous start and are dropped
+     */
+    QHash<quint64, int> firstRows;
+    /**
+     * @brief estimates Last estimate of each cycle in firstRows, the progress bar shows their sum
+     */
+    QHash<quint64, nThroughputModel::Estimate> estimates;
+
+    /**
+     * @brief showEstimate Shows the processed bytes of all cycles of the start and the time until the last one ends
+     */
+    void showEstimate();
 
 private slots:
     /**
@@ -84,14 +97,20 @@ private slots:
     void addLog(const QString& message);
     /**
      * @brief setStatusFile Processing the signal about the percentage of work completed on a file
-     * @param file The file being processed
+     * @param cycle Cycle of the file, the report is dropped if the cycle is not in the list
+     * @param job Index of the file being processed in the table of its cycle
      * @param percent Percentage of completed processing
      */
-    void setStatusFile(const QFileInfo& file, const size_t& percent);
+    void setStatusFile(quint64 cycle, int job, const size_t& percent);
+    /**
+     * @brief setEstimate Updates the estimate of the cycle and shows the sum of all cycles of the start
+     * @param estimate Estimate of a running cycle, dropped if the cycle is not in the list
+     */
+    void setEstimate(const nThroughputModel::Estimate& estimate);
     /**
-     * @brief getAllFiles Getting all found files matching the mask
-     * @param files Files found
+     * @brief getAllFiles Adds the files found by a scan to the list, the files of the running cycles stay in it
+     * @param jobs Table of the files found
      */
-    void getAllFiles(const QList<QFileInfo>& files);
+    void getAllFiles(std::shared_ptr<const nJobTable::JobTable> jobs);
 };
 #endif // MAINWINDOW_H
@@ -0,0 +1,95 @@
+#include "nameallocator.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QRegularExpression>
+#include <algorithm>
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <cerrno>
+#endif
+
+namespace nNameAllocator {
+
+NameAllocator::NameAllocator(const QDir& folder) : folder(folder) {}
+
+QString NameAllocator::keyOf(const QString& baseName, const QString& suffix) {
+    return baseName + "/" + suffix;
+}
+
+void NameAllocator::snapshot() {
+    static const QRegularExpression counterRegex("^(.*)_(\\d+)$");
+    QHash<QString, int> counters;
+    for (const QFileInfo& file : folder.entryInfoList(QDir::Files)) {
+        const QString plainKey = keyOf(file.completeBaseName(), file.suffix());
+        counters[plainKey] = std::max(counters.value(plainKey), 1);
+
+        const QRegularExpressionMatch match = counterRegex.match(file.completeBaseName());
+        if (match.hasMatch()) {
+            const QString key = keyOf(match.captured(1), file.suffix());
+            counters[key] = std::max(counters.value(key), match.captured(2).toInt() + 1);
+        }
+    }
+
+    // Names handed out to the tasks of a cycle that is still running may not exist yet, so no counter goes back
+    QMutexLocker locker(&mutex);
+    for (auto it = nextCounter.constBegin(); it != nextCounter.constEnd(); ++it) {
+        counters[it.key()] = std::max(counters.value(it.key()), it.value());
+    }
+    nextCounter = counters;
+}
+
+QString NameAllocator::nextName(const QString& fileName) {
+    const QFileInfo file(fileName);
+    int counter;
+    {
+        QMutexLocker locker(&mutex);
+        counter = nextCounter[keyOf(file.completeBaseName(), file.suffix())]++;
+    }
+    if (counter == 0) {
+        return folder.filePath(file.fileName());
+    }
+    return folder.filePath(file.completeBaseName() + "_" + QString::number(counter) + "." + file.suffix());
+}
+
+QString NameAllocator::publish(const QString& temporaryPath, const QString& fileName) {
+#ifdef Q_OS_LINUX
+    const QByteArray from = QFile::encodeName(temporaryPath);
+    bool isLinkNeeded = false;
+    for (int attempt = 0; attempt < 1000; ++attempt) {
+        const QString path = nextName(fileName);
+        const QByteArray to = QFile::encodeName(path);
+        if (!isLinkNeeded) {
+            if (::renameat2(AT_FDCWD, from.constData(), AT_FDCWD, to.constData(), RENAME_NOREPLACE) == 0) {
+                return path;
+            }
+            isLinkNeeded = errno == EINVAL || errno == ENOSYS;
+            if (!isLinkNeeded && errno != EEXIST) {
+                return QString();
+            }
+        }
+        if (isLinkNeeded) {
+            // link fails with EEXIST instead of replacing, also on NFS
+            if (::link(from.constData(), to.constData()) == 0) {
+                ::unlink(from.constData());
+                return path;
+            }
+            if (errno != EEXIST) {
+                return QString();
+            }
+        }
+    }
+    return QString();
+#else
+    for (int attempt = 0; attempt < 1000; ++attempt) {
+        const QString path = nextName(fileName);
+        if (!QFile::exists(path)) {
+            return QFile::rename(temporaryPath, path) ? path : QString();
+        }
+    }
+    return QString();
+#endif
+}
+
+}
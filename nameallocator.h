@@ -0,0 +1,63 @@
+/**
+ * @file nameallocator.h
+ * @brief Allocation of unique output names in the AddCounter mode
+ */
+#ifndef NAMEALLOCATOR_H
+#define NAMEALLOCATOR_H
+
+#include <QString>
+#include <QDir>
+#include <QHash>
+#include <QMutex>
+
+/**
+ * @namespace nNameAllocator
+ * @brief Contains class NameAllocator
+ */
+namespace nNameAllocator {
+
+/**
+ * @class NameAllocator
+ * @brief Hands out names of the form name.ext, name_1.ext, name_2.ext ... for one folder.
+ * The folder is scanned once per cycle, after that each name costs O(1) and is never given to two tasks
+ */
+class NameAllocator {
+    QDir folder;
+    QMutex mutex;
+    /**
+     * @brief nextCounter Next counter for "completeBaseName/suffix". 0 means that the name without a counter is free
+     */
+    QHash<QString, int> nextCounter;
+
+    static QString keyOf(const QString& baseName, const QString& suffix);
+
+public:
+    /**
+     * @brief NameAllocator Constructor
+     * @param folder Folder in which the names are allocated
+     */
+    explicit NameAllocator(const QDir& folder);
+    /**
+     * @brief snapshot Remembers the largest used counter for each name in the folder. Called at the start of each cycle
+     */
+    void snapshot();
+    /**
+     * @brief nextName Hands out the next name without touching the file system
+     * @param fileName Name of the source file
+     * @return Full path in the folder
+     */
+    QString nextName(const QString& fileName);
+    /**
+     * @brief publish Renames a completely written file to the next free name. The rename never replaces a file
+     * (renameat2 with RENAME_NOREPLACE, or link and unlink where the file system does not support it, as NFS), so the result
+     * appears under its final name at once
+     * @param temporaryPath Written and closed file in the folder
+     * @param fileName Name of the source file
+     * @return Full path of the published file or empty string on error
+     */
+    QString publish(const QString& temporaryPath, const QString& fileName);
+};
+
+}
+
+#endif // NAMEALLOCATOR_H
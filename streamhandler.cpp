@@ -0,0 +1,237 @@
+#include "streamhandler.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <vector>
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#endif
+
+namespace nStreamHandler {
+
+namespace {
+
+const qint64 progressInterval = 100;
+
+#ifdef Q_OS_LINUX
+bool isPipe(int descriptor) {
+    struct stat status;
+    return ::fstat(descriptor, &status) == 0 && S_ISFIFO(status.st_mode);
+}
+
+bool waitFor(int descriptor, short events) {
+    pollfd request{descriptor, events, 0};
+    while (::poll(&request, 1, -1) < 0) {
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+    return true;
+}
+
+qint64 readSome(int descriptor, char* data, qint64 size) {
+    for (;;) {
+        const ssize_t result = ::read(descriptor, data, static_cast<size_t>(size));
+        if (result >= 0) {
+            return result;
+        }
+        if (errno == EAGAIN && waitFor(descriptor, POLLIN)) {
+            continue;
+        }
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+}
+
+bool writeAll(int descriptor, const char* data, qint64 size) {
+    while (size > 0) {
+        const ssize_t result = ::write(descriptor, data, static_cast<size_t>(size));
+        if (result < 0) {
+            if (errno == EAGAIN && waitFor(descriptor, POLLOUT)) {
+                continue;
+            }
+            if (errno != EINTR) {
+                return false;
+            }
+            continue;
+        }
+        data += result;
+        size -= result;
+    }
+    return true;
+}
+
+bool spliceAll(int descriptor, char* data, qint64 size) {
+    while (size > 0) {
+        iovec vector{data, static_cast<size_t>(size)};
+        const ssize_t result = ::vmsplice(descriptor, &vector, 1, 0);
+        if (result < 0) {
+            if (errno == EAGAIN && waitFor(descriptor, POLLOUT)) {
+                continue;
+            }
+            if (errno != EINTR) {
+                return false;
+            }
+            continue;
+        }
+        data += result;
+        size -= result;
+    }
+    return true;
+}
+
+struct FreeBuffer {
+    void operator()(char* buffer) const { std::free(buffer); }
+};
+
+/**
+ * @brief A buffer passed to the pipe with vmsplice.
+ * The pipe refers to its pages until the reader copies them out, so it is filled again only
+ * after at least the whole capacity of the pipe was spliced behind it
+ */
+struct SplicedBuffer {
+    std::unique_ptr<char, FreeBuffer> data;
+    quint64 releasedAt = 0;
+};
+#endif
+
+}
+
+StreamHandler::StreamHandler(std::shared_ptr<const nTransform::Transform> transform, const StreamOptions& options) :
+    transform(std::move(transform)), options(options) {
+}
+
+bool StreamHandler::run(int inputDescriptor, int outputDescriptor) {
+    if (!transform || options.bufferSize <= 0) {
+        emit logMessage("Stream: no transformation or empty buffer");
+        return false;
+    }
+#ifdef Q_OS_LINUX
+    return runLinux(inputDescriptor, outputDescriptor);
+#else
+    return runPortable(inputDescriptor, outputDescriptor);
+#endif
+}
+
+bool StreamHandler::runPortable(int inputDescriptor, int outputDescriptor) {
+    QFile input;
+    QFile output;
+    if (!input.open(inputDescriptor, QIODevice::ReadOnly | QIODevice::Unbuffered, QFileDevice::DontCloseHandle)
+        || !output.open(outputDescriptor, QIODevice::WriteOnly | QIODevice::Unbuffered, QFileDevice::DontCloseHandle)) {
+        emit logMessage("Stream: failed to open the descriptors");
+        return false;
+    }
+
+    QByteArray buffer(options.bufferSize, Qt::Uninitialized);
+    quint64 offset = 0;
+    QElapsedTimer timer;
+    timer.start();
+    for (;;) {
+        const qint64 size = input.read(buffer.data(), buffer.size());
+        if (size < 0) {
+            emit logMessage("Stream: read error after " + QString::number(offset) + " bytes");
+            return false;
+        }
+        if (size == 0) {
+            break;
+        }
+        transform->apply(buffer.data(), size, offset);
+        if (output.write(buffer.constData(), size) != size) {
+            emit logMessage("Stream: write error after " + QString::number(offset) + " bytes");
+            return false;
+        }
+        offset += size;
+        if (timer.elapsed() >= progressInterval) {
+            emit processedBytes(offset);
+            timer.restart();
+        }
+    }
+    emit processedBytes(offset);
+    return true;
+}
+
+#ifdef Q_OS_LINUX
+bool StreamHandler::runLinux(int inputDescriptor, int outputDescriptor) {
+    // A larger pipe means fewer wakeups of both sides for the same amount of data
+    const bool outputIsPipe = isPipe(outputDescriptor);
+    if (options.pipeSize > 0) {
+        if (isPipe(inputDescriptor)) {
+            ::fcntl(inputDescriptor, F_SETPIPE_SZ, options.pipeSize);
+        }
+        if (outputIsPipe) {
+            ::fcntl(outputDescriptor, F_SETPIPE_SZ, options.pipeSize);
+        }
+    }
+
+    const long pageSize = ::sysconf(_SC_PAGESIZE);
+    const qint64 bufferSize = (options.bufferSize + pageSize - 1) / pageSize * pageSize;
+    const bool useVmsplice = options.useVmsplice && outputIsPipe;
+
+    std::vector<char> copyBuffer(static_cast<size_t>(bufferSize));
+    std::vector<SplicedBuffer> ring(useVmsplice ? 4 : 0);
+    for (SplicedBuffer& buffer : ring) {
+        void* data = nullptr;
+        if (::posix_memalign(&data, static_cast<size_t>(pageSize), static_cast<size_t>(bufferSize)) != 0) {
+            emit logMessage("Stream: failed to allocate buffers");
+            return false;
+        }
+        buffer.data.reset(static_cast<char*>(data));
+    }
+
+    // Pipe buffers filled by vmsplice so far. Each spliced page takes at least one pipe buffer,
+    // pages written with write are not counted, so the value never runs ahead of the real one
+    quint64 splicedPages = 0;
+    size_t current = 0;
+    quint64 offset = 0;
+    QElapsedTimer timer;
+    timer.start();
+    for (;;) {
+        SplicedBuffer* spliced = nullptr;
+        if (useVmsplice && splicedPages >= ring[current].releasedAt) {
+            spliced = &ring[current];
+        }
+        char* data = spliced ? spliced->data.get() : copyBuffer.data();
+
+        const qint64 size = readSome(inputDescriptor, data, bufferSize);
+        if (size < 0) {
+            emit logMessage("Stream: read error after " + QString::number(offset) + " bytes");
+            return false;
+        }
+        if (size == 0) {
+            break;
+        }
+        transform->apply(data, size, offset);
+
+        if (spliced) {
+            if (!spliceAll(outputDescriptor, data, size)) {
+                emit logMessage("Stream: vmsplice error after " + QString::number(offset) + " bytes");
+                return false;
+            }
+            splicedPages += static_cast<quint64>((size + pageSize - 1) / pageSize);
+            const int pipeSize = ::fcntl(outputDescriptor, F_GETPIPE_SZ);
+            const quint64 pipePages = static_cast<quint64>(pipeSize > 0 ? pipeSize / pageSize : 16);
+            spliced->releasedAt = splicedPages + pipePages;
+            current = (current + 1) % ring.size();
+        } else if (!writeAll(outputDescriptor, data, size)) {
+            emit logMessage("Stream: write error after " + QString::number(offset) + " bytes");
+            return false;
+        }
+
+        offset += static_cast<quint64>(size);
+        if (timer.elapsed() >= progressInterval) {
+            emit processedBytes(offset);
+            timer.restart();
+        }
+    }
+    emit processedBytes(offset);
+    return true;
+}
+#endif
+
+}
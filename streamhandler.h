@@ -0,0 +1,86 @@
+/**
+ * @file streamhandler.h
+ * @brief Processing of a stream (stdin, pipe, FIFO) without a known size
+ */
+#ifndef STREAMHANDLER_H
+#define STREAMHANDLER_H
+
+#include <QObject>
+#include <QString>
+#include <memory>
+#include "transform.h"
+
+/**
+ * @namespace nStreamHandler
+ * @brief Contains class StreamHandler and struct StreamOptions
+ */
+namespace nStreamHandler {
+
+/**
+ * @struct StreamOptions
+ * @brief Parameters of the stream processing
+ */
+struct StreamOptions {
+    /**
+     * @brief bufferSize Size of one reusable buffer
+     */
+    qint64 bufferSize = 1024 * 1024;
+    /**
+     * @brief pipeSize Requested capacity of the input and output pipes (F_SETPIPE_SZ), 0 keeps the system value
+     */
+    int pipeSize = 1024 * 1024;
+    /**
+     * @brief useVmsplice If the output is a pipe, pass the buffers to it with vmsplice instead of copying them with write.
+     * The reader of the pipe must copy the data out (read). It must not move it further with splice or tee,
+     * otherwise a reused buffer can change data that has not been written yet
+     */
+    bool useVmsplice = false;
+};
+
+/**
+ * @class StreamHandler
+ * @brief Reads the input until its end, transforms the data with the same transformation as the files and writes it to the output.
+ * Progress is reported in bytes, because the size of a stream is not known
+ */
+class StreamHandler : public QObject {
+    Q_OBJECT
+
+    std::shared_ptr<const nTransform::Transform> transform;
+    StreamOptions options;
+
+    bool runPortable(int inputDescriptor, int outputDescriptor);
+#ifdef Q_OS_LINUX
+    bool runLinux(int inputDescriptor, int outputDescriptor);
+#endif
+
+public:
+    /**
+     * @brief StreamHandler Constructor
+     * @param transform Transformation of the data
+     * @param options Buffers and the way of writing to a pipe
+     */
+    StreamHandler(std::shared_ptr<const nTransform::Transform> transform, const StreamOptions& options = StreamOptions());
+    /**
+     * @brief run Processes the whole stream. The descriptors are not closed
+     * @param inputDescriptor Descriptor of the input, for example 0 (stdin) or an opened FIFO
+     * @param outputDescriptor Descriptor of the output, for example 1 (stdout)
+     * @return False if reading or writing failed
+     */
+    bool run(int inputDescriptor, int outputDescriptor);
+
+signals:
+    /**
+     * @brief processedBytes Number of bytes written so far. Sent not more often than every 100 ms and once at the end
+     * @param bytes Processed bytes
+     */
+    void processedBytes(quint64 bytes);
+    /**
+     * @brief logMessage Passes information up
+     * @param message Why the message was sent
+     */
+    void logMessage(const QString& message);
+};
+
+}
+
+#endif // STREAMHANDLER_H
@@ -4,15 +4,37 @@
 #include <QDir>
 #include <QSignalSpy>
 #include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QDateTime>
+#include <thread>
+#include <functional>
+#ifdef Q_OS_LINUX
+#include <sys/resource.h>
+#include <csignal>
+#endif
 #include "generalhandler.h"
 #include "localhandler.h"
+#include "xorkey.h"
+#include "transform.h"
+#include "commitstage.h"
+#include "nameallocator.h"
+#include "jobtable.h"
+#include "container.h"
+#include "streamhandler.h"
+#include "claimdirectory.h"
+#include "dispatchqueue.h"
+#include "throughputmodel.h"
 
 class TestableHandler : public nGeneralHandler::GeneralHandler {
 public:
     using nGeneralHandler::GeneralHandler::getInputParams;
     using nGeneralHandler::GeneralHandler::findFilesByMask;
+    using nGeneralHandler::GeneralHandler::transformForFile;
+    std::shared_ptr<const nJobTable::JobTable> lastJobs;
 protected:
-    void startTasks(const QList<QFileInfo>& files) override {}
+    void startTasks(std::shared_ptr<const nJobTable::JobTable> jobs) override {
+        lastJobs = jobs;
+    }
 };
 
 TEST(GeneralHandlerTest, InvalidFolders) {
@@ -112,18 +134,20 @@ TEST(GeneralHandlerTest, FindAllFilesByMask) {
         tempDir.path(),
         "*.txt; file3.log"
     );
+    ASSERT_FALSE(result);
 
     handler.findFilesByMask();
 
     EXPECT_EQ(spy.count(), 1);
 
-    QList<QVariant> arguments = spy.takeFirst();
-    QList<QFileInfo> files = qvariant_cast<QList<QFileInfo>>(arguments.at(0));
+    ASSERT_TRUE(handler.lastJobs);
+    const nJobTable::JobTable& files = *handler.lastJobs;
 
     EXPECT_EQ(files.size(), 3);
-    EXPECT_EQ(files[0].fileName(), "file1.txt");
-    EXPECT_EQ(files[1].fileName(), "file2.txt");
-    EXPECT_EQ(files[2].fileName(), "file3.log");
+    EXPECT_EQ(files.cycle(), 1u);
+    EXPECT_EQ(files.fileName(0), "file1.txt");
+    EXPECT_EQ(files.fileName(1), "file2.txt");
+    EXPECT_EQ(files.fileName(2), "file3.log");
 }
 
 TEST(LocalHandlerTest, CorrectFileConversion) {
@@ -138,7 +162,7 @@ TEST(LocalHandlerTest, CorrectFileConversion) {
 
     std::atomic<bool> stopped{false};
     std::atomic<bool> paused{false};
-    nLocalHandler::LocalHandler handler = nLocalHandler::LocalHandler(nLocalHandler::ConflictMode::Overwrite, "0x1234567890ABCDEF", QFileInfo(file.fileName()),
+    nLocalHandler::LocalHandler handler = nLocalHandler::LocalHandler(nLocalHandler::ConflictMode::Overwrite, std::make_shared<nTransform::FixedXorTransform>(nXorKey::XorKey::fromString("0x1234567890ABCDEF")), QFileInfo(file.fileName()),
                                                                       QDir(tempDir.path()), false, paused, stopped);
 
     handler.run();
@@ -168,7 +192,7 @@ TEST(LocalHandlerTest, DeleteFileAfterConversionIsCorrect) {
 
     std::atomic<bool> stopped{false};
     std::atomic<bool> paused{false};
-    nLocalHandler::LocalHandler handler = nLocalHandler::LocalHandler(nLocalHandler::ConflictMode::AddCounter, "0x1234567890ABCDEF", QFileInfo(file.fileName()),
+    nLocalHandler::LocalHandler handler = nLocalHandler::LocalHandler(nLocalHandler::ConflictMode::AddCounter, std::make_shared<nTransform::FixedXorTransform>(nXorKey::XorKey::fromString("0x1234567890ABCDEF")), QFileInfo(file.fileName()),
                                                                       QDir(tempDir.path()), true, paused, stopped);
 
     handler.run();
@@ -177,3 +201,785 @@ TEST(LocalHandlerTest, DeleteFileAfterConversionIsCorrect) {
     QFileInfo resultFile(tempDir.path() + "/file_1.txt");
     EXPECT_TRUE(resultFile.exists());
 }
+
+TEST(XorKeyTest, HexValueIsDecodedAsBytes) {
+    auto bigEndian = nXorKey::XorKey::fromString("0x1234567890ABCDEF");
+    ASSERT_TRUE(bigEndian);
+    EXPECT_EQ(bigEndian->value(), 0x1234567890ABCDEFULL);
+    QByteArray data(8, '\0');
+    bigEndian->apply(data.data(), data.size(), 0);
+    EXPECT_EQ(data, QByteArray::fromHex("1234567890ABCDEF"));
+
+    nXorKey::KeyFormat format;
+    format.order = nXorKey::ByteOrder::LittleEndian;
+    auto littleEndian = nXorKey::XorKey::fromString("0x1234567890ABCDEF", format);
+    ASSERT_TRUE(littleEndian);
+    data.fill('\0');
+    littleEndian->apply(data.data(), data.size(), 0);
+    EXPECT_EQ(data, QByteArray::fromHex("EFCDAB9078563412"));
+
+    format.legacy = true;
+    auto legacy = nXorKey::XorKey::fromString("0x1234567890ABCDEF", format);
+    ASSERT_TRUE(legacy);
+    data.fill('\0');
+    legacy->apply(data.data(), data.size(), 0);
+    EXPECT_EQ(data, QByteArray("0x123456"));
+
+    EXPECT_FALSE(nXorKey::XorKey::fromString("0x1234567890ABCDEG"));
+}
+
+TEST(XorKeyTest, OffsetSelectsPhase) {
+    auto key = nXorKey::XorKey::fromString("0x1234567890ABCDEF");
+    ASSERT_TRUE(key);
+    const QByteArray keyBytes = QByteArray::fromHex("1234567890ABCDEF");
+
+    QByteArray data(203, 'a');
+    const quint64 offset = 5;
+    key->apply(data.data(), data.size(), offset);
+    for (int i = 0; i < data.size(); ++i) {
+        EXPECT_EQ(static_cast<char>('a' ^ keyBytes[(offset + i) % 8]), data[i]);
+    }
+}
+
+TEST(TransformTest, KeyStreamIsOffsetAddressable) {
+    nTransform::TransformOptions options;
+    options.kind = nTransform::TransformKind::KeyStream;
+    options.keyStreamBlockSize = 100;
+    auto transform = nTransform::create(nXorKey::XorKey::fromString("0x1234567890ABCDEF"), options);
+    ASSERT_TRUE(transform);
+
+    const QByteArray source(1000, 'x');
+    QByteArray whole = source;
+    transform->apply(whole.data(), whole.size(), 0);
+
+    QByteArray chunked = source;
+    for (qint64 offset = 0; offset < chunked.size(); offset += 37) {
+        const qint64 size = std::min<qint64>(37, chunked.size() - offset);
+        transform->apply(chunked.data() + offset, size, offset);
+    }
+    EXPECT_EQ(whole, chunked);
+    EXPECT_NE(whole.mid(0, 8), whole.mid(100, 8));
+
+    transform->apply(whole.data(), whole.size(), 0);
+    EXPECT_EQ(whole, source);
+}
+
+TEST(GeneralHandlerTest, MaskWithOwnKey) {
+    QTemporaryDir tempDir;
+    ASSERT_TRUE(tempDir.isValid());
+
+    TestableHandler handler;
+    nGeneralHandler::CommonModeTreatment mode{0, nGeneralHandler::ModeTreatment::OneTimeTreatment};
+
+    bool result = handler.getInputParams(
+        "0x1234567890ABCDEF",
+        false,
+        nLocalHandler::ConflictMode::Overwrite,
+        mode,
+        tempDir.path(),
+        tempDir.path(),
+        "*.txt; *.bin:0x1111111111111111"
+    );
+    ASSERT_FALSE(result);
+
+    QByteArray txt(8, '\0');
+    handler.transformForFile(QFileInfo(tempDir.path() + "/a.txt"))->apply(txt.data(), txt.size(), 0);
+    EXPECT_EQ(txt, QByteArray::fromHex("1234567890ABCDEF"));
+    QByteArray bin(8, '\0');
+    handler.transformForFile(QFileInfo(tempDir.path() + "/a.bin"))->apply(bin.data(), bin.size(), 0);
+    EXPECT_EQ(bin, QByteArray::fromHex("1111111111111111"));
+}
+
+TEST(CommitStageTest, BatchIsPublishedWithoutReplacing) {
+    QTemporaryDir tempDir;
+    ASSERT_TRUE(tempDir.isValid());
+
+    QString filePath = tempDir.path() + "/file.txt";
+    QFile file(filePath);
+    file.open(QIODevice::WriteOnly);
+    file.write("Hello world!");
+    file.close();
+
+    std::atomic<bool> stopped{false};
+    std::atomic<bool> paused{false};
+    nCommitStage::CommitOptions options;
+    options.batchSize = 10;
+    auto commitStage = std::make_shared<nCommitStage::CommitStage>(options);
+    auto nameAllocator = std::make_shared<nNameAllocator::NameAllocator>(QDir(tempDir.path()));
+    nameAllocator->snapshot();
+    commitStage->setNameAllocator(nameAllocator);
+    nLocalHandler::LocalHandler handler = nLocalHandler::LocalHandler(nLocalHandler::ConflictMode::AddCounter, std::make_shared<nTransform::FixedXorTransform>(nXorKey::XorKey::fromString("0x1234567890ABCDEF")), QFileInfo(file.fileName()),
+                                                                      QDir(tempDir.path()), true, paused, stopped);
+    handler.setCommitStage(commitStage);
+
+    handler.run();
+    EXPECT_TRUE(QFileInfo(filePath).exists());
+    EXPECT_FALSE(QFileInfo(tempDir.path() + "/file_1.txt").exists());
+
+    commitStage->flush();
+    EXPECT_FALSE(QFileInfo(filePath).exists());
+    EXPECT_FALSE(QFileInfo(tempDir.path() + "/file.txt.tmp").exists());
+    EXPECT_TRUE(QFileInfo(tempDir.path() + "/file_1.txt").exists());
+}
+
+TEST(NameAllocatorTest, CountersContinueAfterSnapshot) {
+    QTemporaryDir tempDir;
+    ASSERT_TRUE(tempDir.isValid());
+
+    for (const QString& name : {QString("a.txt"), QString("a_1.txt"), QString("a_7.txt")}) {
+        QFile file(tempDir.path() + "/" + name);
+        file.open(QIODevice::WriteOnly);
+        file.close();
+    }
+
+    QDir folder(tempDir.path());
+    nNameAllocator::NameAllocator allocator(folder);
+    allocator.snapshot();
+
+    EXPECT_EQ(allocator.nextName("a.txt"), folder.filePath("a_8.txt"));
+    EXPECT_EQ(allocator.nextName("b.txt"), folder.filePath("b.txt"));
+
+    // The snapshot does not know a file created by someone else, publishing skips it instead of replacing it
+    QFile concurrent(folder.filePath("a_9.txt"));
+    concurrent.open(QIODevice::WriteOnly);
+    concurrent.close();
+    QFile written(folder.filePath("a.txt.tmp"));
+    written.open(QIODevice::WriteOnly);
+    written.write("abc");
+    written.close();
+    EXPECT_EQ(allocator.publish(written.fileName(), "a.txt"), folder.filePath("a_10.txt"));
+    EXPECT_EQ(QFileInfo(folder.filePath("a_9.txt")).size(), 0);
+    EXPECT_EQ(QFileInfo(folder.filePath("a_10.txt")).size(), 3);
+    EXPECT_FALSE(written.exists());
+
+    // A name handed out to a task of a running cycle is not given again after the snapshot of the next cycle
+    EXPECT_EQ(allocator.nextName("b.txt"), folder.filePath("b_1.txt"));
+    allocator.snapshot();
+    EXPECT_EQ(allocator.nextName("b.txt"), folder.filePath("b_2.txt"));
+}
+
+TEST(LocalHandlerTest, SparseFileConversion) {
+    QTemporaryDir tempDir;
+    ASSERT_TRUE(tempDir.isValid());
+
+    QString filePath = tempDir.path() + "/sparse.bin";
+    QFile file(filePath);
+    ASSERT_TRUE(file.open(QIODevice::WriteOnly));
+    file.write(QByteArray(10, 'A'));
+    file.seek(3 * 1024 * 1024);
+    file.write("B");
+    file.close();
+
+    QFile source(filePath);
+    ASSERT_TRUE(source.open(QIODevice::ReadOnly));
+    const QByteArray sourceData = source.readAll();
+    source.close();
+
+    auto key = nXorKey::XorKey::fromString("0x1234567890ABCDEF");
+    std::atomic<bool> stopped{false};
+    std::atomic<bool> paused{false};
+    nLocalHandler::LocalHandler handler = nLocalHandler::LocalHandler(nLocalHandler::ConflictMode::Overwrite, std::make_shared<nTransform::FixedXorTransform>(key), QFileInfo(filePath),
+                                                                      QDir(tempDir.path()), false, paused, stopped);
+
+    handler.run();
+    QByteArray expected = sourceData;
+    key->apply(expected.data(), expected.size(), 0);
+    QFile afterKeyPattern(filePath);
+    ASSERT_TRUE(afterKeyPattern.open(QIODevice::ReadOnly));
+    EXPECT_EQ(afterKeyPattern.readAll(), expected);
+    afterKeyPattern.close();
+    handler.run();
+
+    handler.setHoleMode(nLocalHandler::HoleMode::Preserve);
+    handler.run();
+    handler.run();
+    QFile afterPreserve(filePath);
+    ASSERT_TRUE(afterPreserve.open(QIODevice::ReadOnly));
+    EXPECT_EQ(afterPreserve.readAll(), sourceData);
+}
+
+TEST(LocalHandlerTest, OverwrittenSmallFileMovesIntoSegment) {
+    QTemporaryDir tempDir;
+    ASSERT_TRUE(tempDir.isValid());
+    QDir folder(tempDir.path());
+
+    QString filePath = tempDir.path() + "/file.txt";
+    QFile file(filePath);
+    ASSERT_TRUE(file.open(QIODevice::WriteOnly));
+    file.write("Hello world!");
+    file.close();
+
+    auto key = nXorKey::XorKey::fromString("0x1234567890ABCDEF");
+    std::atomic<bool> stopped{false};
+    std::atomic<bool> paused{false};
+    auto writer = std::make_shared<nContainer::SegmentWriter>(folder, nContainer::ContainerOptions());
+    nLocalHandler::LocalHandler handler = nLocalHandler::LocalHandler(nLocalHandler::ConflictMode::Overwrite, std::make_shared<nTransform::FixedXorTransform>(key), QFileInfo(filePath),
+                                                                      folder, false, paused, stopped);
+    handler.setSegmentWriter(writer);
+    handler.run();
+
+    // The source is still the only copy of the data until the segment is complete
+    EXPECT_TRUE(QFile::exists(filePath));
+    ASSERT_TRUE(writer->close());
+    EXPECT_FALSE(QFile::exists(filePath));
+
+    const QStringList segments = folder.entryList({"*" + nContainer::SegmentWriter::extension}, QDir::Files);
+    ASSERT_EQ(segments.size(), 1);
+    nContainer::SegmentReader reader;
+    ASSERT_TRUE(reader.open(folder.filePath(segments.first())));
+    ASSERT_EQ(reader.entries().size(), 1);
+    EXPECT_EQ(reader.entries().first().name, "file.txt");
+    QByteArray expected("Hello world!");
+    key->apply(expected.data(), expected.size(), 0);
+    bool ok = false;
+    EXPECT_EQ(reader.read(0, &ok), expected);
+    EXPECT_TRUE(ok);
+}
+
+TEST(GeneralHandlerTest, ProcessingDoesNotWaitForBusyUiThread) {
+    int argc = 0;
+    char** argv = nullptr;
+    QCoreApplication app(argc, argv);
+    QTemporaryDir tempDir;
+    ASSERT_TRUE(tempDir.isValid());
+
+    const int filesCount = QThreadPool::globalInstance()->maxThreadCount() * 4 * 3;
+    for (int i = 0; i < filesCount; ++i) {
+        QFile file(tempDir.path() + "/file" + QString::number(i) + ".txt");
+        file.open(QIODevice::WriteOnly);
+        file.write("Hello world!");
+        file.close();
+    }
+
+    nGeneralHandler::GeneralHandler handler;
+    nGeneralHandler::CommonModeTreatment mode{0, nGeneralHandler::ModeTreatment::OneTimeTreatment};
+    handler.start("0x1234567890ABCDEF", true, nLocalHandler::ConflictMode::AddCounter, mode,
+                  tempDir.path(), tempDir.path(), "*.txt");
+
+    // The test thread plays the role of a UI that never returns to its event loop
+    QDir folder(tempDir.path());
+    QElapsedTimer timer;
+    timer.start();
+    while (folder.entryList({"*_1.txt"}, QDir::Files).size() < filesCount && timer.elapsed() < 20000) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    EXPECT_EQ(folder.entryList({"*_1.txt"}, QDir::Files).size(), filesCount);
+}
+
+TEST(GeneralHandlerTest, UrgentFileFoundDuringBatchIsStartedFirst) {
+    int argc = 0;
+    char** argv = nullptr;
+    QCoreApplication app(argc, argv);
+    QTemporaryDir tempDir;
+    ASSERT_TRUE(tempDir.isValid());
+    const auto createFile = [&tempDir](const QString& name) {
+        QFile file(tempDir.path() + "/" + name);
+        file.open(QIODevice::WriteOnly);
+        file.write(QByteArray(64 * 1024, 'x'));
+        file.close();
+    };
+    for (int i = 0; i < 20; ++i) {
+        createFile("bulk" + QString::number(i) + ".log");
+    }
+
+    const int threads = QThreadPool::globalInstance()->maxThreadCount();
+    QThreadPool::globalInstance()->setMaxThreadCount(1);
+    QMutex mutex;
+    QHash<quint64, std::shared_ptr<const nJobTable::JobTable>> tables;
+    QStringList completed;
+    {
+        nGeneralHandler::GeneralHandler handler;
+        // Both run in the threads of the handler, the test thread never enters an event loop
+        QObject::connect(&handler, &nGeneralHandler::GeneralHandler::findFiles, &handler,
+                         [&handler, &mutex, &tables](std::shared_ptr<const nJobTable::JobTable> jobs) {
+            QMutexLocker locker(&mutex);
+            // The batch waits until the urgent file has been found by the next scan
+            if (tables.isEmpty()) {
+                handler.pause();
+            }
+            tables.insert(jobs->cycle(), jobs);
+        }, Qt::DirectConnection);
+        QObject::connect(&handler, &nGeneralHandler::GeneralHandler::sendStatusFile, &handler,
+                         [&mutex, &tables, &completed](quint64 cycle, int job, const size_t& percent) {
+            QMutexLocker locker(&mutex);
+            if (percent == 100 && tables.contains(cycle)) {
+                completed.append(tables.value(cycle)->fileName(job));
+            }
+        }, Qt::DirectConnection);
+
+        nGeneralHandler::CommonModeTreatment mode{1, nGeneralHandler::ModeTreatment::TimerTreatment};
+        handler.start("0x1234567890ABCDEF", true, nLocalHandler::ConflictMode::AddCounter, mode,
+                      tempDir.path(), tempDir.path(), "*.log@0 *.bin@10");
+
+        const auto waitFor = [&mutex](const std::function<bool()>& condition) {
+            QElapsedTimer timer;
+            timer.start();
+            for (;;) {
+                {
+                    QMutexLocker locker(&mutex);
+                    if (condition() || timer.elapsed() > 20000) {
+                        return;
+                    }
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            }
+        };
+        waitFor([&tables]() { return !tables.isEmpty(); });
+        createFile("urgent.bin");
+        waitFor([&tables]() {
+            for (const auto& jobs : tables) {
+                if (jobs->size() == 1 && jobs->fileName(0) == "urgent.bin") {
+                    return true;
+                }
+            }
+            return false;
+        });
+        handler.resume();
+        waitFor([&completed]() { return completed.size() >= 21; });
+        handler.stop();
+    }
+    QThreadPool::globalInstance()->setMaxThreadCount(threads);
+
+    ASSERT_GE(completed.size(), 21);
+    EXPECT_EQ(completed.first(), "urgent.bin");
+}
+
+namespace {
+
+/**
+ * @brief runTimerCycleWithRescans Processes a0.dat ... a3.dat in the timer mode with one worker. The handler is paused
+ * when the first file is done, so the timer scans the folder twice while the results of the cycle are not published yet
+ * @param configure Selects how the results are published
+ * @return Number of files found by all scans
+ */
+int runTimerCycleWithRescans(const QString& folderPath, nLocalHandler::ConflictMode conflict,
+                              const std::function<void(nGeneralHandler::GeneralHandler&)>& configure) {
+    for (int i = 0; i < 4; ++i) {
+        QFile file(folderPath + "/a" + QString::number(i) + ".dat");
+        file.open(QIODevice::WriteOnly);
+        file.write(QByteArray(16 * 1024, 'a' + i));
+        file.close();
+    }
+
+    const int threads = QThreadPool::globalInstance()->maxThreadCount();
+    QThreadPool::globalInstance()->setMaxThreadCount(1);
+    std::atomic<bool> isPaused{false};
+    std::atomic<int> finishedCycles{0};
+    std::atomic<int> found{0};
+    {
+        nGeneralHandler::GeneralHandler handler;
+        configure(handler);
+        QObject::connect(&handler, &nGeneralHandler::GeneralHandler::sendStatusFile, &handler,
+                         [&handler, &isPaused](quint64, int, const size_t& percent) {
+            if (percent == 100 && !isPaused.exchange(true)) {
+                handler.pause();
+            }
+        }, Qt::DirectConnection);
+        QObject::connect(&handler, &nGeneralHandler::GeneralHandler::cycleFinished, &handler, [&finishedCycles]() {
+            finishedCycles.fetch_add(1);
+        }, Qt::DirectConnection);
+        QObject::connect(&handler, &nGeneralHandler::GeneralHandler::findFiles, &handler,
+                         [&found](std::shared_ptr<const nJobTable::JobTable> jobs) {
+            found.fetch_add(jobs->size());
+        }, Qt::DirectConnection);
+
+        // The outputs do not match the masks, only the sources are found again
+        nGeneralHandler::CommonModeTreatment mode{1, nGeneralHandler::ModeTreatment::TimerTreatment};
+        handler.start("0x1234567890ABCDEF", true, conflict, mode, folderPath, folderPath, "a0.dat a1.dat a2.dat a3.dat");
+
+        QElapsedTimer timer;
+        timer.start();
+        while (!isPaused.load() && timer.elapsed() < 20000) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(2500));
+        handler.resume();
+        while (finishedCycles.load() == 0 && timer.elapsed() < 20000) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        // The next scans must not find anything to process
+        std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+        handler.stop();
+    }
+    QThreadPool::globalInstance()->setMaxThreadCount(threads);
+    return found.load();
+}
+
+}
+
+TEST(GeneralHandlerTest, BatchCommitFilesAreNotFoundAgainBeforePublication) {
+    QTemporaryDir tempDir;
+    ASSERT_TRUE(tempDir.isValid());
+    nCommitStage::CommitOptions options;
+    options.batchSize = 100;
+    const int found = runTimerCycleWithRescans(tempDir.path(), nLocalHandler::ConflictMode::AddCounter,
+                                               [&options](nGeneralHandler::GeneralHandler& handler) {
+        handler.setBatchCommit(true, options);
+    });
+    EXPECT_EQ(found, 4);
+
+    QDir folder(tempDir.path());
+    EXPECT_EQ(folder.entryList({"*.tmp"}, QDir::Files).size(), 0);
+    EXPECT_EQ(folder.entryList({"a?.dat"}, QDir::Files).size(), 0);
+    EXPECT_EQ(folder.entryList({"*_2.dat"}, QDir::Files).size(), 0);
+    for (int i = 0; i < 4; ++i) {
+        QFile output(folder.filePath("a" + QString::number(i) + "_1.dat"));
+        ASSERT_TRUE(output.open(QIODevice::ReadOnly));
+        EXPECT_EQ(output.size(), 16 * 1024);
+    }
+}
+
+TEST(GeneralHandlerTest, PackedFilesAreNotFoundAgainBeforeTheSegmentIsSealed) {
+    QTemporaryDir tempDir;
+    ASSERT_TRUE(tempDir.isValid());
+    const int found = runTimerCycleWithRescans(tempDir.path(), nLocalHandler::ConflictMode::Overwrite,
+                                               [](nGeneralHandler::GeneralHandler& handler) {
+        handler.setContainerOutput(true);
+    });
+    EXPECT_EQ(found, 4);
+
+    QDir folder(tempDir.path());
+    EXPECT_EQ(folder.entryList({"a?.dat"}, QDir::Files).size(), 0);
+    const QStringList segments = folder.entryList({"*" + nContainer::SegmentWriter::extension}, QDir::Files);
+    ASSERT_EQ(segments.size(), 1);
+    nContainer::SegmentReader reader;
+    ASSERT_TRUE(reader.open(folder.filePath(segments.first())));
+    ASSERT_EQ(reader.entries().size(), 4);
+    const nTransform::FixedXorTransform transform(nXorKey::XorKey::fromString("0x1234567890ABCDEF"));
+    for (int i = 0; i < 4; ++i) {
+        QByteArray expected(16 * 1024, 'a' + i);
+        transform.apply(expected.data(), expected.size(), 0);
+        bool ok = false;
+        EXPECT_EQ(reader.read(reader.find("a" + QString::number(i) + ".dat"), &ok), expected);
+        EXPECT_TRUE(ok);
+    }
+}
+
+TEST(JobTableTest, JobsShareFoldersAndTransforms) {
+    QTemporaryDir tempDir;
+    ASSERT_TRUE(tempDir.isValid());
+
+    auto transform = nTransform::create(nXorKey::XorKey::fromString("0x1234567890ABCDEF"), nTransform::TransformOptions());
+    nJobTable::JobTable jobs;
+    const quint32 outputFolderId = jobs.addFolder(QDir(tempDir.path()));
+    for (int i = 0; i < 3; ++i) {
+        QFile file(tempDir.path() + "/file" + QString::number(i) + ".txt");
+        file.open(QIODevice::WriteOnly);
+        file.write(QByteArray(i + 1, 'x'));
+        file.close();
+        EXPECT_EQ(jobs.add(QFileInfo(file.fileName()), outputFolderId, jobs.addTransform(transform)), i);
+    }
+
+    ASSERT_EQ(jobs.size(), 3);
+    EXPECT_EQ(jobs.at(2).size, 3);
+    EXPECT_EQ(jobs.at(0).inputFolderId, outputFolderId);
+    EXPECT_EQ(jobs.at(1).transformId, jobs.at(2).transformId);
+    EXPECT_EQ(jobs.fileName(1), "file1.txt");
+    EXPECT_EQ(jobs.fileInfo(1).absoluteFilePath(), QDir(tempDir.path()).absoluteFilePath("file1.txt"));
+    EXPECT_EQ(jobs.transform(0), transform);
+}
+
+TEST(ContainerTest, SegmentRoundTrip) {
+    EXPECT_EQ(nContainer::crc32("123456789", 9), 0xCBF43926u);
+
+    QTemporaryDir tempDir;
+    ASSERT_TRUE(tempDir.isValid());
+    QDir folder(tempDir.path());
+
+    {
+        nContainer::SegmentWriter writer(folder, nContainer::ContainerOptions());
+        EXPECT_TRUE(writer.append("a.txt", "first"));
+        EXPECT_TRUE(writer.append("b.txt", QByteArray()));
+        EXPECT_TRUE(writer.append("c.txt", QByteArray(5000, 'c')));
+        EXPECT_TRUE(writer.append("a.txt", "second"));
+        EXPECT_TRUE(writer.close());
+    }
+
+    const QStringList segments = folder.entryList({"*" + nContainer::SegmentWriter::extension}, QDir::Files);
+    ASSERT_EQ(segments.size(), 1);
+
+    nContainer::SegmentReader reader;
+    ASSERT_TRUE(reader.open(folder.filePath(segments.first())));
+    ASSERT_EQ(reader.entries().size(), 4);
+    bool ok = false;
+    EXPECT_EQ(reader.read(reader.find("c.txt"), &ok), QByteArray(5000, 'c'));
+    EXPECT_TRUE(ok);
+    EXPECT_EQ(reader.read(reader.find("a.txt"), &ok), QByteArray("first"));
+    EXPECT_TRUE(ok);
+    EXPECT_EQ(reader.read(reader.find("a_1.txt"), &ok), QByteArray("second"));
+    EXPECT_TRUE(ok);
+    EXPECT_EQ(reader.find("missing.txt"), -1);
+
+    QTemporaryDir extractDir;
+    ASSERT_TRUE(extractDir.isValid());
+    ASSERT_TRUE(nContainer::extract(folder.filePath(segments.first()), QDir(extractDir.path())));
+    QFile extracted(extractDir.path() + "/a.txt");
+    ASSERT_TRUE(extracted.open(QIODevice::ReadOnly));
+    EXPECT_EQ(extracted.readAll(), QByteArray("first"));
+}
+
+#ifdef Q_OS_LINUX
+TEST(ContainerTest, FailedWriteDropsTheSegment) {
+    QTemporaryDir tempDir;
+    ASSERT_TRUE(tempDir.isValid());
+    QDir folder(tempDir.path());
+    QFile input(folder.filePath("input.txt"));
+    ASSERT_TRUE(input.open(QIODevice::WriteOnly));
+    input.close();
+
+    // A full disk: writes past 1 MB fail with EFBIG instead of killing the process
+    rlimit limit;
+    ASSERT_EQ(::getrlimit(RLIMIT_FSIZE, &limit), 0);
+    const rlimit full{1024 * 1024, limit.rlim_max};
+    const auto previousHandler = ::signal(SIGXFSZ, SIG_IGN);
+    ASSERT_EQ(::setrlimit(RLIMIT_FSIZE, &full), 0);
+    {
+        nContainer::SegmentWriter writer(folder, nContainer::ContainerOptions());
+        EXPECT_TRUE(writer.append("a.txt", "first", input.fileName()));
+        EXPECT_FALSE(writer.append("b.txt", QByteArray(5 * 1024 * 1024, 'b')));
+        EXPECT_TRUE(writer.append("c.txt", "third"));
+        EXPECT_FALSE(writer.close());
+    }
+    ::setrlimit(RLIMIT_FSIZE, &limit);
+    ::signal(SIGXFSZ, previousHandler);
+
+    // Only the segment with c.txt is complete, the dropped one left no part file and kept its source
+    const QStringList segments = folder.entryList({"*" + nContainer::SegmentWriter::extension}, QDir::Files);
+    ASSERT_EQ(segments.size(), 1);
+    EXPECT_EQ(folder.entryList({"*.part"}, QDir::Files).size(), 0);
+    EXPECT_TRUE(input.exists());
+    nContainer::SegmentReader reader;
+    ASSERT_TRUE(reader.open(folder.filePath(segments.first())));
+    ASSERT_EQ(reader.entries().size(), 1);
+    EXPECT_EQ(reader.entries().first().name, QString("c.txt"));
+}
+#endif
+
+TEST(StreamHandlerTest, StreamMatchesWholeFileTransform) {
+    QTemporaryDir tempDir;
+    ASSERT_TRUE(tempDir.isValid());
+
+    QByteArray data(100000, Qt::Uninitialized);
+    for (int i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<char>(i * 31 + 7);
+    }
+    QFile input(tempDir.path() + "/input.bin");
+    ASSERT_TRUE(input.open(QIODevice::WriteOnly));
+    input.write(data);
+    input.close();
+
+    nTransform::TransformOptions options;
+    options.kind = nTransform::TransformKind::KeyStream;
+    options.keyStreamBlockSize = 1000;
+    const auto transform = nTransform::create(nXorKey::XorKey::fromString("0x0123456789ABCDEF"), options);
+    ASSERT_TRUE(transform);
+
+    // A buffer that does not divide the key stream blocks checks that offsets continue across reads
+    nStreamHandler::StreamOptions streamOptions;
+    streamOptions.bufferSize = 4099;
+    nStreamHandler::StreamHandler handler(transform, streamOptions);
+    QSignalSpy spy(&handler, &nStreamHandler::StreamHandler::processedBytes);
+
+    QFile output(tempDir.path() + "/output.bin");
+    ASSERT_TRUE(input.open(QIODevice::ReadOnly | QIODevice::Unbuffered));
+    ASSERT_TRUE(output.open(QIODevice::WriteOnly | QIODevice::Unbuffered));
+    ASSERT_TRUE(handler.run(input.handle(), output.handle()));
+    input.close();
+    output.close();
+
+    ASSERT_FALSE(spy.isEmpty());
+    EXPECT_EQ(spy.last().at(0).toULongLong(), static_cast<quint64>(data.size()));
+
+    transform->apply(data.data(), data.size(), 0);
+    ASSERT_TRUE(output.open(QIODevice::ReadOnly));
+    EXPECT_EQ(output.readAll(), data);
+}
+
+TEST(ClaimDirectoryTest, EachFileHasOneOwnerAndDeadLeasesExpire) {
+    QTemporaryDir tempDir;
+    ASSERT_TRUE(tempDir.isValid());
+    QDir folder(tempDir.path());
+    QFile file(folder.filePath("shared.bin"));
+    ASSERT_TRUE(file.open(QIODevice::WriteOnly));
+    file.close();
+    const QFileInfo info(file.fileName());
+
+    nClaimDirectory::ClaimOptions options;
+    options.leaseTimeout = 50;
+    options.instanceId = "first";
+    nClaimDirectory::ClaimDirectory first(folder, options);
+    options.instanceId = "second";
+    nClaimDirectory::ClaimDirectory second(folder, options);
+    ASSERT_TRUE(first.heartbeat());
+    ASSERT_TRUE(second.heartbeat());
+
+    EXPECT_TRUE(first.claim(info));
+    EXPECT_FALSE(second.claim(info));
+    EXPECT_EQ(first.release(), 1);
+    EXPECT_TRUE(second.claim(info));
+
+    // A live instance keeps its claims: the lease changes between the observations
+    EXPECT_EQ(first.recoverExpired(), 0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    ASSERT_TRUE(second.heartbeat());
+    EXPECT_EQ(first.recoverExpired(), 0);
+    EXPECT_FALSE(first.claim(info));
+
+    // The second instance stops renewing its lease and its claim is dropped after the timeout
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT_EQ(first.recoverExpired(), 1);
+    EXPECT_TRUE(first.claim(info));
+}
+
+TEST(ClaimDirectoryTest, ProcessedContentIsNotClaimedAgain) {
+    QTemporaryDir tempDir;
+    ASSERT_TRUE(tempDir.isValid());
+    QDir folder(tempDir.path());
+    QFile file(folder.filePath("shared.bin"));
+    ASSERT_TRUE(file.open(QIODevice::WriteOnly));
+    file.write("abc");
+    file.close();
+    // Listing made before the file is processed
+    const QFileInfo stale(file.fileName());
+
+    nClaimDirectory::ClaimOptions options;
+    options.instanceId = "first";
+    nClaimDirectory::ClaimDirectory first(folder, options);
+    options.instanceId = "second";
+    nClaimDirectory::ClaimDirectory second(folder, options);
+    // As on the start of the handler, the first heartbeat creates the folder of the locks
+    ASSERT_TRUE(first.heartbeat());
+    ASSERT_TRUE(second.heartbeat());
+
+    // The first instance processes the file: the lock stays as a done marker
+    ASSERT_TRUE(first.claim(stale));
+    ASSERT_TRUE(first.complete(stale.absoluteFilePath()));
+    EXPECT_FALSE(second.claim(stale));
+    EXPECT_FALSE(first.claim(stale));
+    EXPECT_EQ(first.release(), 0);
+
+    // An output is marked before it gets its final name, so it is never claimed
+    QFile output(folder.filePath("output.tmp"));
+    ASSERT_TRUE(output.open(QIODevice::WriteOnly));
+    output.write("xyz");
+    output.close();
+    ASSERT_TRUE(first.markDone(output.fileName()));
+    ASSERT_TRUE(output.rename(folder.filePath("output.bin")));
+    EXPECT_FALSE(second.claim(QFileInfo(output.fileName())));
+
+    // New content under the same name has another identity and is claimed once
+    ASSERT_TRUE(file.remove());
+    ASSERT_TRUE(file.open(QIODevice::WriteOnly));
+    file.write("abcdef");
+    file.close();
+    const QFileInfo fresh(file.fileName());
+    EXPECT_TRUE(second.claim(fresh));
+    EXPECT_FALSE(first.claim(fresh));
+
+    // A claim from a listing made before the file was replaced does not take the new content
+    second.abandon(fresh.absoluteFilePath());
+    ASSERT_TRUE(file.remove());
+    EXPECT_FALSE(first.claim(fresh));
+}
+
+TEST(DispatchQueueTest, PriorityAgingAndDeadlines) {
+    QTemporaryDir tempDir;
+    ASSERT_TRUE(tempDir.isValid());
+    const auto createFile = [&tempDir](const QString& name, int size) {
+        QFile file(tempDir.path() + "/" + name);
+        file.open(QIODevice::WriteOnly);
+        file.write(QByteArray(size, 'x'));
+        file.close();
+        return QFileInfo(file.fileName());
+    };
+
+    QList<nDispatchQueue::PriorityClass> classes;
+    classes.append({"*.log", 0, 0});
+    classes.append({"*.bin", 5, 0});
+    classes.append({"*.dat", -10, 1000});
+    classes.append({"*.now", 8, 0});
+
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    nJobTable::JobTable jobs;
+    const quint32 folderId = jobs.addFolder(QDir(tempDir.path()));
+    const int bulk = jobs.add(createFile("bulk.log", 1000), folderId, 0, 0, now);
+    const int big = jobs.add(createFile("big.bin", 1000), folderId, 0, 1, now);
+    const int small = jobs.add(createFile("small.bin", 10), folderId, 0, 1, now);
+    // Waited longer than 5 priority levels are worth
+    const int old = jobs.add(createFile("old.log", 1000), folderId, 0, 0, now - 60000);
+    // More than half of its target latency has passed
+    const int late = jobs.add(createFile("late.dat", 1000), folderId, 0, 2, now - 600);
+
+    nDispatchQueue::DispatchQueue queue(10000);
+    queue.push(1, jobs, classes);
+    EXPECT_EQ(queue.next(now).job, late);
+    EXPECT_EQ(queue.next(now).job, old);
+
+    // A file of a later scan is started before the rest of the earlier batch
+    nJobTable::JobTable urgentJobs(2);
+    const int urgent = urgentJobs.add(createFile("urgent.now", 1000), urgentJobs.addFolder(QDir(tempDir.path())), 0, 3, now);
+    queue.push(2, urgentJobs, classes);
+    const nDispatchQueue::DispatchQueue::Item item = queue.next(now);
+    EXPECT_EQ(item.batch, 2u);
+    EXPECT_EQ(item.job, urgent);
+
+    EXPECT_EQ(queue.next(now).job, small);
+    EXPECT_EQ(queue.next(now).job, big);
+    EXPECT_EQ(queue.next(now).job, bulk);
+    EXPECT_TRUE(queue.isEmpty());
+    EXPECT_EQ(queue.next(now).job, -1);
+
+    nDispatchQueue::LatencyStats stats;
+    for (int i = 1; i <= 100; ++i) {
+        stats.add(1, i);
+    }
+    const auto summary = stats.summary();
+    ASSERT_EQ(summary.size(), 1);
+    EXPECT_EQ(summary.first().priorityClass, 1);
+    EXPECT_EQ(summary.first().p50, 50);
+    EXPECT_EQ(summary.first().p99, 99);
+    EXPECT_EQ(summary.first().max, 100);
+}
+
+TEST(ThroughputModelTest, PreflightAndEstimate) {
+    QTemporaryDir tempDir;
+    ASSERT_TRUE(tempDir.isValid());
+    nJobTable::JobTable jobs;
+    const quint32 outputFolderId = jobs.addFolder(QDir(tempDir.path()));
+    for (int size : {1000, 3000}) {
+        QFile file(tempDir.path() + "/file_" + QString::number(size) + ".bin");
+        file.open(QIODevice::WriteOnly);
+        file.write(QByteArray(size, 'x'));
+        file.close();
+        jobs.add(QFileInfo(file.fileName()), outputFolderId, 0);
+    }
+
+    const auto totals = nThroughputModel::preflight(jobs);
+    ASSERT_EQ(totals.size(), 1);
+    EXPECT_EQ(totals.first().files, 2);
+    EXPECT_EQ(totals.first().readBytes, 4000u);
+    EXPECT_EQ(totals.first().writeBytes, 4000u);
+
+    nThroughputModel::ThroughputModel model(jobs);
+    EXPECT_EQ(model.estimate().totalBytes, 4000u);
+    EXPECT_EQ(model.estimate().remainingMs, -1);
+
+    // The first sample covers the time since the task started, not since the model was created
+    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+    model.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    model.update(0, 500);
+    // Reports beyond the size of the scan are not counted
+    model.update(0, 5000);
+    auto estimate = model.estimate();
+    EXPECT_EQ(estimate.processedBytes, 1000u);
+    EXPECT_GT(estimate.bytesPerSecond, 2000);
+    EXPECT_GE(estimate.remainingMs, 0);
+
+    // A task that stopped without processing its file takes it out of the work instead of counting it as done
+    model.finish(1);
+    estimate = model.estimate();
+    EXPECT_EQ(estimate.processedBytes, 1000u);
+    EXPECT_EQ(estimate.totalBytes, 1000u);
+    EXPECT_EQ(estimate.remainingMs, 0);
+}
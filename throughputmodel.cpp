@@ -0,0 +1,126 @@
+#include "throughputmodel.h"
+#include <QStorageInfo>
+#include <algorithm>
+#include <cmath>
+
+namespace nThroughputModel {
+
+namespace {
+
+const qint64 minimalSampleNs = 1000000;
+
+}
+
+QList<DeviceTotal> preflight(const nJobTable::JobTable& jobs) {
+    QList<DeviceTotal> totals;
+    QHash<QString, int> byDevice;
+    QHash<QString, int> deviceOfFolder;
+    const auto totalOf = [&](const QString& folder) -> DeviceTotal& {
+        auto known = deviceOfFolder.constFind(folder);
+        if (known != deviceOfFolder.constEnd()) {
+            return totals[known.value()];
+        }
+        const QStorageInfo storage(folder);
+        const QString device = storage.isValid() ? QString::fromUtf8(storage.device()) : folder;
+        int index = byDevice.value(device, -1);
+        if (index == -1) {
+            index = totals.size();
+            DeviceTotal total;
+            total.device = device;
+            total.rootPath = storage.isValid() ? storage.rootPath() : folder;
+            totals.append(total);
+            byDevice.insert(device, index);
+        }
+        deviceOfFolder.insert(folder, index);
+        return totals[index];
+    };
+
+    for (int i = 0; i < jobs.size(); ++i) {
+        const nJobTable::Job& job = jobs.at(i);
+        DeviceTotal& input = totalOf(jobs.folder(job.inputFolderId));
+        input.readBytes += static_cast<quint64>(job.size);
+        ++input.files;
+        totalOf(jobs.folder(job.outputFolderId)).writeBytes += static_cast<quint64>(job.size);
+    }
+    return totals;
+}
+
+ThroughputModel::ThroughputModel(const nJobTable::JobTable& jobs, qint64 timeConstant) :
+    cycle(jobs.cycle()), timeConstant(std::max<qint64>(1, timeConstant)), sizes(jobs.size()), reported(jobs.size(), 0), totalBytes(0), processedBytes(0) {
+    for (int i = 0; i < jobs.size(); ++i) {
+        sizes[i] = std::max<qint64>(0, jobs.at(i).size);
+        totalBytes += static_cast<quint64>(sizes[i]);
+    }
+    clock.start();
+}
+
+ThroughputModel::Worker& ThroughputModel::workerOf(qint64 now) {
+    auto it = workers.find(QThread::currentThreadId());
+    if (it == workers.end()) {
+        Worker worker;
+        worker.lastUpdate = now;
+        it = workers.insert(QThread::currentThreadId(), worker);
+    }
+    return it.value();
+}
+
+void ThroughputModel::start() {
+    QMutexLocker locker(&mutex);
+    workerOf(clock.nsecsElapsed());
+}
+
+void ThroughputModel::update(int job, qint64 processed) {
+    QMutexLocker locker(&mutex);
+    if (job < 0 || job >= static_cast<int>(sizes.size())) {
+        return;
+    }
+    // The file may have changed since the scan, the total stays the one that was announced
+    const qint64 delta = std::clamp(processed, reported[job], sizes[job]) - reported[job];
+    reported[job] += delta;
+    processedBytes += static_cast<quint64>(delta);
+
+    const qint64 now = clock.nsecsElapsed();
+    Worker& worker = workerOf(now);
+    worker.pendingBytes += delta;
+    const qint64 elapsed = now - worker.lastUpdate;
+    if (elapsed < minimalSampleNs) {
+        return;
+    }
+    const double sample = worker.pendingBytes * 1e9 / elapsed;
+    const double weight = 1.0 - std::exp(-static_cast<double>(elapsed) / (timeConstant * 1e6));
+    worker.rate = worker.hasRate ? weight * sample + (1.0 - weight) * worker.rate : sample;
+    worker.hasRate = true;
+    worker.pendingBytes = 0;
+    worker.lastUpdate = now;
+}
+
+void ThroughputModel::finish(int job) {
+    QMutexLocker locker(&mutex);
+    if (job < 0 || job >= static_cast<int>(sizes.size())) {
+        return;
+    }
+    totalBytes -= static_cast<quint64>(sizes[job] - reported[job]);
+    sizes[job] = reported[job];
+}
+
+Estimate ThroughputModel::estimate() const {
+    QMutexLocker locker(&mutex);
+    Estimate result;
+    result.cycle = cycle;
+    result.processedBytes = processedBytes;
+    result.totalBytes = totalBytes;
+    const qint64 now = clock.nsecsElapsed();
+    for (const Worker& worker : workers) {
+        if (worker.hasRate && now - worker.lastUpdate < 2 * timeConstant * 1000000) {
+            result.bytesPerSecond += worker.rate;
+        }
+    }
+    if (processedBytes >= totalBytes) {
+        result.remainingMs = 0;
+    } else if (result.bytesPerSecond > 0) {
+        result.remainingMs = static_cast<qint64>((totalBytes - processedBytes) / result.bytesPerSecond * 1000);
+    }
+    return result;
+}
+
+}
@@ -0,0 +1,127 @@
+/**
+ * @file throughputmodel.h
+ * @brief Pre-flight totals of a cycle and the estimate of its remaining time
+ */
+#ifndef THROUGHPUTMODEL_H
+#define THROUGHPUTMODEL_H
+
+#include <QString>
+#include <QList>
+#include <QHash>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QMetaType>
+#include <vector>
+#include "jobtable.h"
+
+/**
+ * @namespace nThroughputModel
+ * @brief Contains class ThroughputModel, structs DeviceTotal and Estimate and function preflight
+ */
+namespace nThroughputModel {
+
+/**
+ * @struct DeviceTotal
+ * @brief Bytes that a cycle reads from and writes to one device
+ */
+struct DeviceTotal {
+    QString device;
+    QString rootPath;
+    quint64 readBytes = 0;
+    quint64 writeBytes = 0;
+    int files = 0;
+};
+
+/**
+ * @struct Estimate
+ * @brief Progress of a cycle in bytes and its expected end
+ */
+struct Estimate {
+    /**
+     * @brief cycle Number of the cycle, see JobTable::cycle
+     */
+    quint64 cycle = 0;
+    quint64 processedBytes = 0;
+    quint64 totalBytes = 0;
+    /**
+     * @brief bytesPerSecond Sum of the smoothed rates of the workers that are busy now
+     */
+    double bytesPerSecond = 0;
+    /**
+     * @brief remainingMs Expected time until the end of the cycle, -1 while there is no rate yet
+     */
+    qint64 remainingMs = -1;
+};
+
+/**
+ * @brief preflight Totals the sizes of the jobs per device of their input and output folders
+ * @param jobs Table of the cycle
+ */
+QList<DeviceTotal> preflight(const nJobTable::JobTable& jobs);
+
+/**
+ * @class ThroughputModel
+ * @brief Estimates the remaining time of a cycle from the processed bytes.
+ *
+ * Each worker thread has an exponentially weighted byte rate with the time constant timeConstant,
+ * the weight of a sample depends on the time it covers, so irregular updates are handled correctly.
+ * The time between the files of a worker is part of its rate, so a corpus of many small files is not estimated as if it were one stream.
+ * The rate of the cycle is the sum over the workers that have reported within two time constants.
+ * Can be used from several threads
+ */
+class ThroughputModel {
+    struct Worker {
+        qint64 lastUpdate = 0;
+        qint64 pendingBytes = 0;
+        double rate = 0;
+        bool hasRate = false;
+    };
+
+    mutable QMutex mutex;
+    quint64 cycle;
+    QElapsedTimer clock;
+    qint64 timeConstant;
+    std::vector<qint64> sizes;
+    std::vector<qint64> reported;
+    quint64 totalBytes;
+    quint64 processedBytes;
+    QHash<Qt::HANDLE, Worker> workers;
+
+    /**
+     * @brief workerOf Worker of the calling thread. A new worker starts measuring now. The mutex must be locked
+     */
+    Worker& workerOf(qint64 now);
+
+public:
+    /**
+     * @brief ThroughputModel Constructor
+     * @param jobs Table of the cycle, its total size is the work to do
+     * @param timeConstant Smoothing time in ms
+     */
+    explicit ThroughputModel(const nJobTable::JobTable& jobs, qint64 timeConstant = 2000);
+    /**
+     * @brief start Called by a worker thread when it begins a task, so the first rate of the worker covers only its own work
+     */
+    void start();
+    /**
+     * @brief update Called by the worker thread of the job
+     * @param job Index of the job
+     * @param processed Bytes of the file processed so far
+     */
+    void update(int job, qint64 processed);
+    /**
+     * @brief finish Removes the part of the file that was not processed from the total, so a stopped or failed task
+     * ends the estimate without counting bytes that were never processed
+     * @param job Index of the job
+     */
+    void finish(int job);
+    Estimate estimate() const;
+};
+
+}
+
+Q_DECLARE_METATYPE(QList<nThroughputModel::DeviceTotal>)
+Q_DECLARE_METATYPE(nThroughputModel::Estimate)
+
+#endif // THROUGHPUTMODEL_H
@@ -0,0 +1,370 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTemporaryDir>
+#include <QElapsedTimer>
+#include <QDir>
+#include <QFile>
+#include <QThreadPool>
+#include <QMutex>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+#ifdef Q_OS_LINUX
+#include <malloc.h>
+#endif
+#include "generalhandler.h"
+
+namespace {
+
+/**
+ * @struct BenchOptions
+ * @brief Parameters shared by the scenarios
+ */
+struct BenchOptions {
+    QString folderPath;
+    int files;
+    qint64 size;
+    int busy;
+};
+
+bool createFiles(const QDir& folder, int count, qint64 size, const QString& suffix) {
+    const QByteArray data(size, 'x');
+    for (int i = 0; i < count; ++i) {
+        QFile file(folder.filePath("file" + QString::number(i) + suffix));
+        if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size()) {
+            std::cerr << "Failed to create " << file.fileName().toStdString() << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @struct CycleResult
+ * @brief Time of a cycle in ms (-1 if it did not finish) and the progress events that reached the UI thread by then
+ */
+struct CycleResult {
+    qint64 elapsed;
+    qint64 uiEvents;
+};
+
+/**
+ * @brief runOneTime Processes the files of the folder once, while the calling thread plays the role of the UI thread:
+ * it handles the queued progress events and then is blocked for busy ms
+ * @param configure Sets the options of the handler before the start
+ */
+CycleResult runOneTime(const QString& folderPath, int busy,
+                       const std::function<void(nGeneralHandler::GeneralHandler&)>& configure = nullptr) {
+    nGeneralHandler::GeneralHandler handler;
+    if (configure) {
+        configure(handler);
+    }
+    std::atomic<bool> isFinished{false};
+    qint64 uiEvents = 0;
+    QObject::connect(&handler, &nGeneralHandler::GeneralHandler::cycleFinished, [&isFinished]() {
+        isFinished.store(true);
+    });
+    QObject::connect(&handler, &nGeneralHandler::GeneralHandler::sendStatusFile, QCoreApplication::instance(), [&uiEvents]() {
+        ++uiEvents;
+    });
+    QObject::connect(&handler, &nGeneralHandler::GeneralHandler::incorrect, [](std::shared_ptr<QList<nGeneralHandler::IncorrectInput>>) {
+        std::cerr << "The handler rejected the parameters" << std::endl;
+    });
+
+    QElapsedTimer timer;
+    timer.start();
+    const nGeneralHandler::CommonModeTreatment mode{0, nGeneralHandler::ModeTreatment::OneTimeTreatment};
+    handler.start("0x0123456789ABCDEF", true, nLocalHandler::ConflictMode::AddCounter, mode, folderPath, folderPath, "*.dat");
+    while (!isFinished.load() && timer.elapsed() < 600000) {
+        QCoreApplication::processEvents();
+        std::this_thread::sleep_for(std::chrono::milliseconds(std::max(1, busy)));
+    }
+    return CycleResult{isFinished.load() ? timer.elapsed() : -1, uiEvents};
+}
+
+/**
+ * @brief allocatedBytes Bytes allocated on the heap now, -1 if it is not known on this platform
+ */
+qint64 allocatedBytes() {
+#ifdef Q_OS_LINUX
+    return static_cast<qint64>(mallinfo2().uordblks);
+#else
+    return -1;
+#endif
+}
+
+/**
+ * @class NullObserver
+ * @brief Drops the reports of the tasks
+ */
+class NullObserver : public nLocalHandler::TaskObserver {
+public:
+    void taskProgress(int, size_t) override {}
+    void taskLog(const QString&) override {}
+    void taskFinished(int, bool) override {}
+};
+
+/**
+ * @brief dispatch Cost of describing and dispatching one file without processing it. Memory: the list of QFileInfo of the scan
+ * against the job table. Time: a LocalHandler with its signal connections, as it was created per file, against a FileTask
+ * moved into the function that the pool runs
+ */
+int dispatch(const BenchOptions& options) {
+    QTemporaryDir temporaryDir(options.folderPath.isEmpty() ? QDir::tempPath() + "/bench-XXXXXX" : options.folderPath + "/bench-XXXXXX");
+    if (!temporaryDir.isValid() || !createFiles(QDir(temporaryDir.path()), options.files, options.size, ".dat")) {
+        return 1;
+    }
+    const QDir folder(temporaryDir.path());
+    std::cout << "dispatch: " << options.files << " files" << std::endl;
+
+    const qint64 beforeList = allocatedBytes();
+    QList<QFileInfo> entries = folder.entryInfoList(QDir::Files);
+    qint64 listedBytes = 0;
+    for (const QFileInfo& file : entries) {
+        // The scan reads the size, so the cached stat data is part of the descriptor
+        listedBytes += file.size();
+    }
+    const qint64 afterList = allocatedBytes();
+    auto jobs = std::make_shared<nJobTable::JobTable>(1);
+    const quint32 folderId = jobs->addFolder(folder);
+    const quint32 transformId = jobs->addTransform(nTransform::create(nXorKey::XorKey::fromString("0x0123456789ABCDEF"), nTransform::TransformOptions()));
+    jobs->reserve(entries.size());
+    for (const QFileInfo& file : entries) {
+        jobs->add(file, folderId, transformId);
+    }
+    const qint64 afterTable = allocatedBytes();
+    entries.clear();
+    if (beforeList >= 0) {
+        std::cout << "  memory per file: QFileInfo list " << (afterList - beforeList) / options.files << " bytes, job table "
+                  << (afterTable - afterList) / options.files << " bytes, " << listedBytes << " bytes listed" << std::endl;
+    } else {
+        std::cout << "  memory per file: not available on this platform" << std::endl;
+    }
+
+    std::atomic<bool> paused{false};
+    std::atomic<bool> stopped{false};
+    const auto observer = std::make_shared<NullObserver>();
+    QObject receiver;
+    int received = 0;
+    QElapsedTimer timer;
+
+    timer.start();
+    for (int job = 0; job < jobs->size(); ++job) {
+        auto* task = new nLocalHandler::LocalHandler(nLocalHandler::ConflictMode::Overwrite, jobs, job, false, paused, stopped);
+        QObject::connect(task, &nLocalHandler::LocalHandler::logMessage, &receiver, [&received]() { ++received; }, Qt::DirectConnection);
+        QObject::connect(task, &nLocalHandler::LocalHandler::processStatus, &receiver, [&received]() { ++received; }, Qt::DirectConnection);
+        QObject::connect(task, &nLocalHandler::LocalHandler::finished, &receiver, [&received]() { ++received; }, Qt::DirectConnection);
+        delete task;
+    }
+    const qint64 handlerNs = timer.nsecsElapsed();
+
+    timer.restart();
+    for (int job = 0; job < jobs->size(); ++job) {
+        nLocalHandler::FileTask task(nLocalHandler::ConflictMode::Overwrite, jobs, job, false, paused, stopped);
+        task.setObserver(observer.get());
+        QRunnable* runnable = QRunnable::create([task = std::move(task), observer]() mutable {
+            task.run();
+        });
+        delete runnable;
+    }
+    const qint64 taskNs = timer.nsecsElapsed();
+
+    std::cout << "  dispatch per file: LocalHandler with 3 connections " << handlerNs / options.files << " ns, FileTask "
+              << taskNs / options.files << " ns" << std::endl;
+    return received == 0 ? 0 : 2;
+}
+
+/**
+ * @brief container The same corpus of small files written as separate files and packed into segments
+ */
+int container(const BenchOptions& options) {
+    std::cout << "container: " << options.files << " files of " << options.size << " bytes" << std::endl;
+    for (const bool isContainer : {false, true}) {
+        QTemporaryDir temporaryDir(options.folderPath.isEmpty() ? QDir::tempPath() + "/bench-XXXXXX" : options.folderPath + "/bench-XXXXXX");
+        if (!temporaryDir.isValid() || !createFiles(QDir(temporaryDir.path()), options.files, options.size, ".dat")) {
+            return 1;
+        }
+        const CycleResult result = runOneTime(temporaryDir.path(), 0, [isContainer](nGeneralHandler::GeneralHandler& handler) {
+            handler.setContainerOutput(isContainer);
+        });
+        if (result.elapsed < 0) {
+            std::cerr << "The cycle did not finish" << std::endl;
+            return 2;
+        }
+        const QStringList segments = QDir(temporaryDir.path()).entryList({"*" + nContainer::SegmentWriter::extension}, QDir::Files);
+        std::cout << "  " << (isContainer ? "segments:       " : "separate files: ") << result.elapsed << " ms, "
+                  << options.files * 1000.0 / std::max<qint64>(1, result.elapsed) << " files/s, "
+                  << options.files * options.size / 1048576.0 * 1000.0 / std::max<qint64>(1, result.elapsed) << " MB/s";
+        if (isContainer) {
+            std::cout << ", " << segments.size() << " segments";
+        }
+        std::cout << std::endl;
+    }
+    return 0;
+}
+
+/**
+ * @brief uiStall The same cycle with an idle and with a blocked UI thread. The scan, the scheduling and the completion
+ * do not go through the UI thread, so the throughput must not depend on it
+ */
+int uiStall(const BenchOptions& options) {
+    std::cout << "ui-stall: " << options.files << " files of " << options.size << " bytes" << std::endl;
+    qint64 elapsed[2] = {0, 0};
+    const int busy[2] = {0, options.busy};
+    for (int i = 0; i < 2; ++i) {
+        QTemporaryDir temporaryDir(options.folderPath.isEmpty() ? QDir::tempPath() + "/bench-XXXXXX" : options.folderPath + "/bench-XXXXXX");
+        if (!temporaryDir.isValid() || !createFiles(QDir(temporaryDir.path()), options.files, options.size, ".dat")) {
+            return 1;
+        }
+        const CycleResult result = runOneTime(temporaryDir.path(), busy[i]);
+        if (result.elapsed < 0) {
+            std::cerr << "The cycle did not finish" << std::endl;
+            return 2;
+        }
+        elapsed[i] = std::max<qint64>(1, result.elapsed);
+        std::cout << "  UI blocked for " << busy[i] << " ms: " << result.elapsed << " ms, "
+                  << options.files * 1000.0 / elapsed[i] << " files/s, "
+                  << result.uiEvents << " progress events handled by the UI until the end" << std::endl;
+    }
+    std::cout << "  slowdown with the blocked UI thread: " << static_cast<double>(elapsed[1]) / elapsed[0] << "x" << std::endl;
+    return 0;
+}
+
+/**
+ * @brief eta Accuracy of the remaining time. Every estimate sent during a cycle over files of mixed sizes is compared
+ * with the time that the cycle actually still took, the end of the cycle is its last estimate
+ */
+int eta(const BenchOptions& options) {
+    QTemporaryDir temporaryDir(options.folderPath.isEmpty() ? QDir::tempPath() + "/bench-XXXXXX" : options.folderPath + "/bench-XXXXXX");
+    if (!temporaryDir.isValid()) {
+        return 1;
+    }
+    const QDir folder(temporaryDir.path());
+    // From size to 64 * size, evenly spread on a log scale in a fixed random order, so large files come at any point
+    std::mt19937 random(1);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    qint64 totalBytes = 0;
+    for (int i = 0; i < options.files; ++i) {
+        const qint64 size = static_cast<qint64>(options.size * std::pow(64.0, unit(random)));
+        const QByteArray data(size, 'x');
+        QFile file(folder.filePath("file" + QString::number(i) + ".dat"));
+        if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size()) {
+            std::cerr << "Failed to create " << file.fileName().toStdString() << std::endl;
+            return 1;
+        }
+        totalBytes += size;
+    }
+    std::cout << "eta: " << options.files << " files of " << options.size << " to " << options.size * 64 << " bytes, "
+              << totalBytes / 1048576.0 << " MB" << std::endl;
+
+    struct Sample {
+        qint64 at;
+        qint64 remainingMs;
+    };
+    QMutex mutex;
+    std::vector<Sample> samples;
+    QElapsedTimer clock;
+    const CycleResult result = runOneTime(folder.path(), 0, [&mutex, &samples, &clock](nGeneralHandler::GeneralHandler& handler) {
+        // Sent by the dispatcher thread, the time is taken when the estimate is made
+        QObject::connect(&handler, &nGeneralHandler::GeneralHandler::estimate, &handler,
+                         [&mutex, &samples, &clock](const nThroughputModel::Estimate& estimate) {
+            QMutexLocker locker(&mutex);
+            samples.push_back(Sample{clock.elapsed(), estimate.remainingMs});
+        }, Qt::DirectConnection);
+        clock.start();
+    });
+    if (result.elapsed < 0 || samples.empty()) {
+        std::cerr << "The cycle did not finish" << std::endl;
+        return 2;
+    }
+
+    const qint64 end = samples.back().at;
+    std::vector<qint64> absolute;
+    std::vector<double> relative;
+    int withoutRate = 0;
+    for (const Sample& sample : samples) {
+        const qint64 actual = end - sample.at;
+        if (actual <= 0) {
+            continue;
+        }
+        if (sample.remainingMs < 0) {
+            ++withoutRate;
+            continue;
+        }
+        absolute.push_back(std::abs(sample.remainingMs - actual));
+        relative.push_back(100.0 * std::abs(sample.remainingMs - actual) / actual);
+    }
+    std::cout << "  cycle: " << end << " ms, " << absolute.size() << " estimates, " << withoutRate << " without a rate yet" << std::endl;
+    if (absolute.empty()) {
+        std::cout << "  too short for an estimate, use more --files or a larger --size" << std::endl;
+        return 0;
+    }
+    std::sort(absolute.begin(), absolute.end());
+    std::sort(relative.begin(), relative.end());
+    const auto at = [](const auto& sorted, int percent) {
+        return sorted[(sorted.size() - 1) * percent / 100];
+    };
+    std::cout << "  error of the remaining time: p50 " << at(absolute, 50) << " ms (" << at(relative, 50) << "%), p90 "
+              << at(absolute, 90) << " ms (" << at(relative, 90) << "%), max " << absolute.back() << " ms ("
+              << relative.back() << "%)" << std::endl;
+    return 0;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("FileReaderBench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Measures the processing of generated files by GeneralHandler.\n"
+                                     "Scenarios:\n"
+                                     "  ui-stall  files per second with an idle UI thread and with one blocked for --busy ms at a time\n"
+                                     "  dispatch  memory per file description and time to create and dispatch one task\n"
+                                     "  container files per second with and without packing small files into segments\n"
+                                     "  eta       error of the remaining time against the actual end, files of --size to 64 * --size bytes");
+    parser.addHelpOption();
+    parser.addPositionalArgument("scenario", "Name of the scenario");
+    const QCommandLineOption folderOption("folder", "Folder for the temporary files, the system temporary folder if not set", "path");
+    const QCommandLineOption filesOption("files", "Number of files", "count", "2000");
+    const QCommandLineOption sizeOption("size", "Size of a file in bytes", "bytes", "4096");
+    const QCommandLineOption busyOption("busy", "Time in ms for which the UI thread is blocked between its events", "ms", "200");
+    const QCommandLineOption threadsOption("threads", "Number of worker threads, the pool default if not set", "count");
+    parser.addOptions({folderOption, filesOption, sizeOption, busyOption, threadsOption});
+    parser.process(app);
+
+    if (parser.positionalArguments().size() != 1) {
+        parser.showHelp(1);
+    }
+    if (parser.isSet(threadsOption)) {
+        QThreadPool::globalInstance()->setMaxThreadCount(parser.value(threadsOption).toInt());
+    }
+
+    BenchOptions options;
+    options.folderPath = parser.value(folderOption);
+    options.files = std::max(1, parser.value(filesOption).toInt());
+    options.size = std::max<qint64>(1, parser.value(sizeOption).toLongLong());
+    options.busy = std::max(0, parser.value(busyOption).toInt());
+
+    const QString scenario = parser.positionalArguments().first();
+    if (scenario == "ui-stall") {
+        return uiStall(options);
+    }
+    if (scenario == "dispatch") {
+        return dispatch(options);
+    }
+    if (scenario == "container") {
+        return container(options);
+    }
+    if (scenario == "eta") {
+        return eta(options);
+    }
+    std::cerr << "Unknown scenario: " << scenario.toStdString() << std::endl;
+    return 1;
+}
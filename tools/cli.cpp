@@ -0,0 +1,177 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <iostream>
+#include "xorkey.h"
+#include "transform.h"
+#include "streamhandler.h"
+#include "generalhandler.h"
+
+namespace {
+
+int runStream(const QCommandLineParser& parser, const std::shared_ptr<const nTransform::Transform>& transform,
+              const nStreamHandler::StreamOptions& streamOptions, bool isProgress) {
+    QFile input;
+    QFile output;
+    int inputDescriptor = 0;
+    int outputDescriptor = 1;
+    if (parser.isSet("input")) {
+        input.setFileName(parser.value("input"));
+        if (!input.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
+            std::cerr << "Failed to open " << input.fileName().toStdString() << std::endl;
+            return 1;
+        }
+        inputDescriptor = input.handle();
+    }
+    if (parser.isSet("output")) {
+        output.setFileName(parser.value("output"));
+        if (!output.open(QIODevice::WriteOnly | QIODevice::Unbuffered)) {
+            std::cerr << "Failed to open " << output.fileName().toStdString() << std::endl;
+            return 1;
+        }
+        outputDescriptor = output.handle();
+    }
+
+    nStreamHandler::StreamHandler handler(transform, streamOptions);
+    QObject::connect(&handler, &nStreamHandler::StreamHandler::logMessage, [](const QString& message) {
+        std::cerr << message.toStdString() << std::endl;
+    });
+    if (isProgress) {
+        QObject::connect(&handler, &nStreamHandler::StreamHandler::processedBytes, [](quint64 bytes) {
+            std::cerr << "\r" << bytes << " bytes" << std::flush;
+        });
+    }
+    const bool result = handler.run(inputDescriptor, outputDescriptor);
+    if (isProgress) {
+        std::cerr << std::endl;
+    }
+    return result ? 0 : 1;
+}
+
+int runFolder(QCoreApplication& app, const QCommandLineParser& parser, const nXorKey::KeyFormat& keyFormat,
+              const nTransform::TransformOptions& transformOptions) {
+    if (!parser.isSet("mask")) {
+        std::cerr << "The folder mode needs --mask" << std::endl;
+        return 1;
+    }
+
+    nGeneralHandler::GeneralHandler handler;
+    handler.setKeyFormat(keyFormat);
+    handler.setTransformOptions(transformOptions);
+    if (parser.isSet("claim")) {
+        nClaimDirectory::ClaimOptions claimOptions;
+        claimOptions.instanceId = parser.value("instance");
+        if (parser.isSet("lease-timeout")) {
+            claimOptions.leaseTimeout = parser.value("lease-timeout").toLongLong();
+        }
+        handler.setClaiming(true, claimOptions);
+    }
+
+    int result = 0;
+    QObject::connect(&handler, &nGeneralHandler::GeneralHandler::sendLog, &app, [](const QString& message) {
+        std::cerr << message.toStdString() << std::endl;
+    });
+    QObject::connect(&handler, &nGeneralHandler::GeneralHandler::incorrect, &app, [&app, &result](std::shared_ptr<QList<nGeneralHandler::IncorrectInput>>) {
+        result = 1;
+        app.quit();
+    });
+    if (parser.isSet("progress")) {
+        QObject::connect(&handler, &nGeneralHandler::GeneralHandler::preflight, &app, [](const QList<nThroughputModel::DeviceTotal>& totals) {
+            for (const auto& total : totals) {
+                std::cerr << total.rootPath.toStdString() << " (" << total.device.toStdString() << "): "
+                          << total.files << " files, " << total.readBytes << " bytes to read, "
+                          << total.writeBytes << " bytes to write" << std::endl;
+            }
+        });
+        QObject::connect(&handler, &nGeneralHandler::GeneralHandler::estimate, &app, [](const nThroughputModel::Estimate& estimate) {
+            const double megabyte = 1024.0 * 1024.0;
+            std::cerr << "\r" << static_cast<qint64>(estimate.processedBytes / megabyte) << " / "
+                      << static_cast<qint64>(estimate.totalBytes / megabyte) << " MB, "
+                      << static_cast<qint64>(estimate.bytesPerSecond / megabyte) << " MB/s, ETA ";
+            if (estimate.remainingMs < 0) {
+                std::cerr << "unknown   ";
+            } else {
+                std::cerr << (estimate.remainingMs + 999) / 1000 << " s     ";
+            }
+            std::cerr << (estimate.processedBytes >= estimate.totalBytes ? "\n" : "") << std::flush;
+        });
+    }
+
+    nGeneralHandler::CommonModeTreatment mode;
+    mode.counterToTimer = parser.value("timer").toULongLong();
+    mode.mode = mode.counterToTimer > 0 ? nGeneralHandler::ModeTreatment::TimerTreatment
+                                        : nGeneralHandler::ModeTreatment::OneTimeTreatment;
+    if (mode.mode == nGeneralHandler::ModeTreatment::OneTimeTreatment) {
+        QObject::connect(&handler, &nGeneralHandler::GeneralHandler::cycleFinished, &app, &QCoreApplication::quit);
+    }
+
+    const nLocalHandler::ConflictMode conflict = parser.isSet("add-counter") ? nLocalHandler::ConflictMode::AddCounter
+                                                                              : nLocalHandler::ConflictMode::Overwrite;
+    handler.start(parser.value("key"), parser.isSet("delete"), conflict, mode,
+                  parser.value("folder"), parser.value("folder"), parser.value("mask"));
+    const int exitCode = app.exec();
+    return result != 0 ? result : exitCode;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("FileReaderCli");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Applies the FileReader transformation to a stream (stdin, a pipe or a FIFO) "
+                                     "or, with --folder, to the files of a folder");
+    parser.addHelpOption();
+    const QCommandLineOption keyOption(QStringList{"k", "key"}, "XOR key, 0x and 16 HEX digits", "key");
+    const QCommandLineOption littleEndianOption("little-endian", "Bytes of the key are applied in little-endian order");
+    const QCommandLineOption legacyKeyOption("legacy-key", "Use the first 8 characters of the key string");
+    const QCommandLineOption keyStreamOption("key-stream", "Use the key stream transformation with the block size in bytes", "bytes");
+    const QCommandLineOption inputOption(QStringList{"i", "input"}, "Input file or FIFO, stdin if not set", "path");
+    const QCommandLineOption outputOption(QStringList{"o", "output"}, "Output file or FIFO, stdout if not set", "path");
+    const QCommandLineOption bufferOption("buffer-size", "Size of one buffer in bytes", "bytes");
+    const QCommandLineOption vmspliceOption("vmsplice", "Pass buffers to an output pipe with vmsplice (the reader must not splice or tee them further)");
+    const QCommandLineOption progressOption("progress", "Print processed bytes to stderr, in the folder mode also the bytes per device and the remaining time");
+    const QCommandLineOption folderOption("folder", "Process the files of the folder instead of a stream", "path");
+    const QCommandLineOption maskOption(QStringList{"m", "mask"}, "Masks of the files, for example *.bin;*.txt", "mask");
+    const QCommandLineOption deleteOption("delete", "Delete the source files");
+    const QCommandLineOption addCounterOption("add-counter", "Write name_1.ext ... instead of overwriting the source");
+    const QCommandLineOption timerOption("timer", "Scan the folder every N seconds, 0 for a single scan", "seconds", "0");
+    const QCommandLineOption claimOption("claim", "Share the folder with other instances: every file is processed by one of them");
+    const QCommandLineOption instanceOption("instance", "Name of this instance for --claim, host and process id by default", "name");
+    const QCommandLineOption leaseTimeoutOption("lease-timeout", "Time in ms after which the claims of a silent instance are dropped", "ms");
+    parser.addOptions({keyOption, littleEndianOption, legacyKeyOption, keyStreamOption, inputOption, outputOption,
+                       bufferOption, vmspliceOption, progressOption, folderOption, maskOption, deleteOption,
+                       addCounterOption, timerOption, claimOption, instanceOption, leaseTimeoutOption});
+    parser.process(app);
+
+    if (!parser.isSet(keyOption)) {
+        parser.showHelp(1);
+    }
+
+    nXorKey::KeyFormat keyFormat;
+    keyFormat.order = parser.isSet(littleEndianOption) ? nXorKey::ByteOrder::LittleEndian : nXorKey::ByteOrder::BigEndian;
+    keyFormat.legacy = parser.isSet(legacyKeyOption);
+    nTransform::TransformOptions transformOptions;
+    if (parser.isSet(keyStreamOption)) {
+        transformOptions.kind = nTransform::TransformKind::KeyStream;
+        transformOptions.keyStreamBlockSize = parser.value(keyStreamOption).toULongLong();
+    }
+    const auto transform = nTransform::create(nXorKey::XorKey::fromString(parser.value(keyOption), keyFormat), transformOptions);
+    if (!transform) {
+        std::cerr << "Incorrect key or key stream block size" << std::endl;
+        return 1;
+    }
+
+    if (parser.isSet(folderOption)) {
+        return runFolder(app, parser, keyFormat, transformOptions);
+    }
+
+    nStreamHandler::StreamOptions streamOptions;
+    if (parser.isSet(bufferOption)) {
+        streamOptions.bufferSize = parser.value(bufferOption).toLongLong();
+    }
+    streamOptions.useVmsplice = parser.isSet(vmspliceOption);
+    return runStream(parser, transform, streamOptions, parser.isSet(progressOption));
+}
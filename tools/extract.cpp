@@ -0,0 +1,39 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <iostream>
+#include "container.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("FileReaderExtract");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Extracts the files of FileReader segments (.frseg) into a folder");
+    parser.addHelpOption();
+    parser.addPositionalArgument("folder", "Folder for the extracted files");
+    parser.addPositionalArgument("segments", "Segment files", "segments...");
+    parser.process(app);
+
+    const QStringList arguments = parser.positionalArguments();
+    if (arguments.size() < 2) {
+        parser.showHelp(1);
+    }
+
+    const QDir folder(arguments.first());
+    if (!folder.exists()) {
+        std::cerr << "Folder does not exist: " << arguments.first().toStdString() << std::endl;
+        return 1;
+    }
+
+    int result = 0;
+    for (int i = 1; i < arguments.size(); ++i) {
+        QString error;
+        if (!nContainer::extract(arguments.at(i), folder, &error)) {
+            std::cerr << error.toStdString() << std::endl;
+            result = 1;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,212 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTemporaryDir>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTimer>
+#include <QThreadPool>
+#include <QHash>
+#include <QRegularExpression>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "generalhandler.h"
+
+namespace {
+
+/**
+ * @brief outputName The handler runs in the AddCounter mode, so the output of load_N.bin is published as load_N_1.bin.
+ * An output that a scan processed again gets one more counter: load_N_1_1.bin
+ */
+const QRegularExpression outputName("^load_(\\d+)((?:_\\d+)+)\\.bin$");
+
+struct PendingFile {
+    qint64 arrival;
+    qint64 size;
+};
+
+qint64 percentile(const std::vector<qint64>& sorted, int percent) {
+    return sorted.empty() ? 0 : sorted[(sorted.size() - 1) * percent / 100];
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("FileReaderLoadGen");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Drops files into a folder processed by GeneralHandler in timer mode and measures "
+                                     "the time from arrival to the output and the sustained throughput");
+    parser.addHelpOption();
+    const QCommandLineOption folderOption("folder", "Work folder, a new temporary folder if not set (use a tmpfs path to exclude the disk)", "path");
+    const QCommandLineOption rateOption("rate", "Files per second", "count", "100");
+    const QCommandLineOption durationOption("duration", "Generation time in seconds", "seconds", "10");
+    const QCommandLineOption drainOption("drain", "Maximum time in seconds to wait for the remaining outputs", "seconds", "60");
+    const QCommandLineOption arrivalsOption("arrivals", "Arrival process: poisson or constant", "process", "poisson");
+    const QCommandLineOption distributionOption("distribution", "File sizes: fixed (min-size), uniform or loguniform", "name", "loguniform");
+    const QCommandLineOption minSizeOption("min-size", "Smallest file in bytes", "bytes", "4096");
+    const QCommandLineOption maxSizeOption("max-size", "Largest file in bytes", "bytes", "1048576");
+    const QCommandLineOption timerOption("timer", "Scan interval of the handler in seconds", "seconds", "1");
+    const QCommandLineOption threadsOption("threads", "Number of worker threads, the pool default if not set", "count");
+    const QCommandLineOption batchCommitOption("batch-commit", "Publish the results in durable batches");
+    const QCommandLineOption pollOption("poll", "Interval in ms for checking the outputs", "ms", "20");
+    const QCommandLineOption seedOption("seed", "Seed of the random generator", "number", "1");
+    parser.addOptions({folderOption, rateOption, durationOption, drainOption, arrivalsOption, distributionOption,
+                       minSizeOption, maxSizeOption, timerOption, threadsOption, batchCommitOption, pollOption, seedOption});
+    parser.process(app);
+
+    QTemporaryDir temporaryDir;
+    const QString folderPath = parser.isSet(folderOption) ? parser.value(folderOption) : temporaryDir.path();
+    const QDir folder(folderPath);
+    if (!folder.exists()) {
+        std::cerr << "Folder does not exist: " << folderPath.toStdString() << std::endl;
+        return 1;
+    }
+
+    const double rate = parser.value(rateOption).toDouble();
+    const qint64 duration = parser.value(durationOption).toLongLong() * 1000;
+    const qint64 drain = parser.value(drainOption).toLongLong() * 1000;
+    const bool isPoisson = parser.value(arrivalsOption) == "poisson";
+    const QString distribution = parser.value(distributionOption);
+    const qint64 minSize = std::max<qint64>(1, parser.value(minSizeOption).toLongLong());
+    const qint64 maxSize = std::max(minSize, parser.value(maxSizeOption).toLongLong());
+    if (rate <= 0 || duration <= 0) {
+        std::cerr << "Rate and duration must be positive" << std::endl;
+        return 1;
+    }
+    if (parser.isSet(threadsOption)) {
+        QThreadPool::globalInstance()->setMaxThreadCount(parser.value(threadsOption).toInt());
+    }
+
+    std::mt19937_64 random(parser.value(seedOption).toULongLong());
+    std::exponential_distribution<double> interval(rate / 1000.0);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    const auto nextSize = [&]() -> qint64 {
+        if (distribution == "uniform") {
+            return minSize + static_cast<qint64>(unit(random) * (maxSize - minSize));
+        }
+        if (distribution == "loguniform") {
+            return static_cast<qint64>(std::exp(std::log(static_cast<double>(minSize))
+                                                + unit(random) * (std::log(static_cast<double>(maxSize)) - std::log(static_cast<double>(minSize)))));
+        }
+        return minSize;
+    };
+
+    nGeneralHandler::GeneralHandler handler;
+    handler.setBatchCommit(parser.isSet(batchCommitOption));
+    QObject::connect(&handler, &nGeneralHandler::GeneralHandler::incorrect, &app, [](std::shared_ptr<QList<nGeneralHandler::IncorrectInput>>) {
+        std::cerr << "The handler rejected the parameters" << std::endl;
+        QCoreApplication::exit(1);
+    });
+    nGeneralHandler::CommonModeTreatment mode;
+    mode.mode = nGeneralHandler::ModeTreatment::TimerTreatment;
+    mode.counterToTimer = std::max<quint64>(1, parser.value(timerOption).toULongLong());
+    // The inputs are deleted and the outputs get new names, so an output is recognised by its name and not by its content
+    handler.start("0x0123456789ABCDEF", true, nLocalHandler::ConflictMode::AddCounter, mode, folderPath, folderPath, "*.bin");
+
+    QHash<QString, PendingFile> pending;
+    std::vector<qint64> latencies;
+    qint64 sentFiles = 0;
+    qint64 sentBytes = 0;
+    qint64 completedBytes = 0;
+    qint64 completedInWindow = 0;
+    qint64 lastOutput = 0;
+    int reprocessed = 0;
+    const QByteArray chunk(64 * 1024, '\0');
+
+    const qint64 startTime = QDateTime::currentMSecsSinceEpoch();
+    double nextArrival = 0;
+
+    // Files are written under a hidden name and renamed, the scan of the handler does not see hidden files
+    QTimer generator;
+    QObject::connect(&generator, &QTimer::timeout, &app, [&]() {
+        const qint64 elapsed = QDateTime::currentMSecsSinceEpoch() - startTime;
+        while (nextArrival <= elapsed && nextArrival < duration) {
+            const QString name = "load_" + QString::number(sentFiles) + ".bin";
+            const qint64 size = nextSize();
+            QFile file(folder.filePath("." + name));
+            if (file.open(QIODevice::WriteOnly)) {
+                for (qint64 written = 0; written < size; written += chunk.size()) {
+                    file.write(chunk.constData(), std::min<qint64>(chunk.size(), size - written));
+                }
+                file.close();
+                if (QFile::rename(file.fileName(), folder.filePath(name))) {
+                    pending.insert(name, PendingFile{QDateTime::currentMSecsSinceEpoch(), size});
+                    ++sentFiles;
+                    sentBytes += size;
+                }
+            }
+            nextArrival += isPoisson ? interval(random) : 1000.0 / rate;
+        }
+        if (nextArrival >= duration) {
+            generator.stop();
+        }
+    });
+
+    // The load generator is also the consumer: an output is removed as soon as it is seen, so the next scan does not process it again.
+    // An output appears under its name only when it is completely written (it is renamed into place without replacing)
+    QTimer poller;
+    QObject::connect(&poller, &QTimer::timeout, &app, [&]() {
+        const qint64 now = QDateTime::currentMSecsSinceEpoch();
+        for (const QFileInfo& output : folder.entryInfoList({"load_*.bin"}, QDir::Files)) {
+            const QRegularExpressionMatch match = outputName.match(output.fileName());
+            if (!match.hasMatch()) {
+                continue;
+            }
+            if (match.captured(2).count('_') > 1) {
+                ++reprocessed;
+            }
+            const auto it = pending.find("load_" + match.captured(1) + ".bin");
+            if (it != pending.end()) {
+                // The rename into place updates the ctime of the output
+                const QDateTime changed = output.metadataChangeTime();
+                const qint64 outputTime = changed.isValid() ? std::min(changed.toMSecsSinceEpoch(), now) : now;
+                latencies.push_back(std::max<qint64>(0, outputTime - it.value().arrival));
+                completedBytes += it.value().size;
+                if (outputTime - startTime <= duration) {
+                    ++completedInWindow;
+                }
+                lastOutput = std::max(lastOutput, outputTime);
+                pending.erase(it);
+            }
+            QFile::remove(output.absoluteFilePath());
+        }
+
+        if (now - startTime >= duration && !generator.isActive()
+            && (pending.isEmpty() || now - startTime >= duration + drain)) {
+            app.quit();
+        }
+    });
+
+    generator.start(1);
+    poller.start(parser.value(pollOption).toInt());
+    const int exitCode = app.exec();
+    handler.stop();
+    if (exitCode != 0) {
+        return exitCode;
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    const double seconds = std::max<qint64>(1, lastOutput - startTime) / 1000.0;
+    std::cout << "Sent:       " << sentFiles << " files, " << sentBytes << " bytes, "
+              << sentFiles * 1000.0 / duration << " files/s offered" << std::endl;
+    std::cout << "Completed:  " << latencies.size() << " files, " << pending.size() << " not completed" << std::endl;
+    std::cout << "Throughput: " << latencies.size() / seconds << " files/s, "
+              << completedBytes / seconds / (1024 * 1024) << " MB/s until the last output, "
+              << completedInWindow * 1000.0 / duration << " files/s during generation" << std::endl;
+    std::cout << "Latency:    p50 " << percentile(latencies, 50) << " ms, p99 " << percentile(latencies, 99)
+              << " ms, max " << (latencies.empty() ? 0 : latencies.back()) << " ms" << std::endl;
+
+    // An output that a scan picked up before it was consumed is transformed again and comes back with one more counter
+    if (reprocessed > 0) {
+        std::cout << "Warning:    " << reprocessed << " outputs were processed again before they were consumed, "
+                  << "use a smaller --poll" << std::endl;
+    }
+    return pending.isEmpty() ? 0 : 2;
+}
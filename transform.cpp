@@ -0,0 +1,61 @@
+#include "transform.h"
+#include <algorithm>
+
+namespace nTransform {
+
+FixedXorTransform::FixedXorTransform(std::shared_ptr<const nXorKey::XorKey> key) : key(std::move(key)) {}
+
+void FixedXorTransform::apply(char* data, qint64 size, quint64 offset) const {
+    key->apply(data, size, offset);
+}
+
+KeyStreamTransform::KeyStreamTransform(const std::shared_ptr<const nXorKey::XorKey>& key, quint64 keyStreamBlockSize,
+                                       quint64 counterStart) :
+    baseKey(key->value()), keyStreamBlockSize(keyStreamBlockSize), counterStart(counterStart) {}
+
+quint64 KeyStreamTransform::blockKey(quint64 counter) const {
+    // splitmix64 finalizer: neighbouring counters give unrelated keys
+    quint64 z = baseKey + (counter + 1) * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+void KeyStreamTransform::apply(char* data, qint64 size, quint64 offset) const {
+    alignas(nXorKey::XorKey::laneSize) uchar lane[nXorKey::XorKey::laneSize];
+    while (size > 0) {
+        const quint64 block = offset / keyStreamBlockSize;
+        const quint64 inBlock = offset % keyStreamBlockSize;
+        const qint64 piece = static_cast<qint64>(std::min<quint64>(keyStreamBlockSize - inBlock, size));
+
+        const quint64 value = blockKey(counterStart + block);
+        const int phase = static_cast<int>(inBlock % nXorKey::XorKey::keySize);
+        for (int i = 0; i < nXorKey::XorKey::laneSize; ++i) {
+            const int byte = (phase + i) % nXorKey::XorKey::keySize;
+            lane[i] = static_cast<uchar>(value >> (8 * (nXorKey::XorKey::keySize - 1 - byte)));
+        }
+        nXorKey::XorKey::applyLane(data, piece, lane);
+
+        data += piece;
+        size -= piece;
+        offset += piece;
+    }
+}
+
+std::shared_ptr<const Transform> create(const std::shared_ptr<const nXorKey::XorKey>& key, const TransformOptions& options) {
+    if (!key) {
+        return nullptr;
+    }
+    switch (options.kind) {
+    case TransformKind::FixedXor:
+        return std::make_shared<const FixedXorTransform>(key);
+    case TransformKind::KeyStream:
+        if (options.keyStreamBlockSize == 0) {
+            return nullptr;
+        }
+        return std::make_shared<const KeyStreamTransform>(key, options.keyStreamBlockSize, options.counterStart);
+    }
+    return nullptr;
+}
+
+}
@@ -0,0 +1,104 @@
+/**
+ * @file transform.h
+ * @brief Transformations applied to the file data block by block
+ */
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include <QString>
+#include <QtGlobal>
+#include <memory>
+#include "xorkey.h"
+
+/**
+ * @namespace nTransform
+ * @brief Contains interface Transform, its built-in implementations, enum TransformKind and struct TransformOptions
+ */
+namespace nTransform {
+
+/**
+ * @class Transform
+ * @brief Interface of the transformation. The result depends only on the data and its absolute offset,
+ * so a file can be processed in parallel chunks or resumed from any position
+ */
+class Transform {
+public:
+    virtual ~Transform() = default;
+    /**
+     * @brief apply Transforms a block of the file in place
+     * @param data Data of the block
+     * @param size Size of the block in bytes
+     * @param offset Absolute offset of the block in the file
+     */
+    virtual void apply(char* data, qint64 size, quint64 offset) const = 0;
+};
+
+/**
+ * @class FixedXorTransform
+ * @brief XOR with one 8-byte key repeated over the whole file
+ */
+class FixedXorTransform : public Transform {
+    std::shared_ptr<const nXorKey::XorKey> key;
+public:
+    /**
+     * @brief FixedXorTransform Constructor
+     * @param key Parsed key
+     */
+    explicit FixedXorTransform(std::shared_ptr<const nXorKey::XorKey> key);
+    void apply(char* data, qint64 size, quint64 offset) const override;
+};
+
+/**
+ * @class KeyStreamTransform
+ * @brief XOR with a key stream: every block of keyStreamBlockSize bytes gets its own 8-byte key
+ * derived from the base key and the block counter. It is not a cryptographic cipher
+ */
+class KeyStreamTransform : public Transform {
+    quint64 baseKey;
+    quint64 keyStreamBlockSize;
+    quint64 counterStart;
+public:
+    /**
+     * @brief KeyStreamTransform Constructor
+     * @param key Parsed base key
+     * @param keyStreamBlockSize Number of bytes after which the key is advanced
+     * @param counterStart Value of the counter for the first block of the file
+     */
+    KeyStreamTransform(const std::shared_ptr<const nXorKey::XorKey>& key, quint64 keyStreamBlockSize, quint64 counterStart = 0);
+    void apply(char* data, qint64 size, quint64 offset) const override;
+    /**
+     * @brief blockKey Returns the key of the block with the specified counter value
+     */
+    quint64 blockKey(quint64 counter) const;
+};
+
+/**
+ * @enum TransformKind
+ * @brief Built-in transformations that can be selected by the user
+ */
+enum class TransformKind {
+    FixedXor,
+    KeyStream
+};
+
+/**
+ * @struct TransformOptions
+ * @brief Parameters for creating a built-in transformation
+ */
+struct TransformOptions {
+    TransformKind kind = TransformKind::FixedXor;
+    quint64 keyStreamBlockSize = 1024 * 1024;
+    quint64 counterStart = 0;
+};
+
+/**
+ * @brief create Creates a built-in transformation
+ * @param key Parsed key
+ * @param options Selected transformation and its parameters
+ * @return Transformation or nullptr if the options are incorrect
+ */
+std::shared_ptr<const Transform> create(const std::shared_ptr<const nXorKey::XorKey>& key, const TransformOptions& options);
+
+}
+
+#endif // TRANSFORM_H
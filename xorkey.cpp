@@ -0,0 +1,70 @@
+#include "xorkey.h"
+#include <QRegularExpression>
+#include <QByteArray>
+#include <cstring>
+
+namespace nXorKey {
+
+std::shared_ptr<const XorKey> XorKey::fromString(const QString& key, const KeyFormat& format) {
+    static const QRegularExpression hexRegex("^0x[0-9A-Fa-f]{16}$");
+    if (!hexRegex.match(key).hasMatch()) {
+        return nullptr;
+    }
+
+    std::array<uchar, keySize> bytes{};
+    if (format.legacy) {
+        const QByteArray keyBytes = key.toUtf8();
+        for (int i = 0; i < keySize; ++i) {
+            bytes[i] = static_cast<uchar>(keyBytes[i]);
+        }
+        return std::make_shared<const XorKey>(bytes);
+    }
+
+    bool ok = false;
+    const quint64 value = key.mid(2).toULongLong(&ok, 16);
+    if (!ok) {
+        return nullptr;
+    }
+    for (int i = 0; i < keySize; ++i) {
+        const int shift = format.order == ByteOrder::BigEndian ? 8 * (keySize - 1 - i) : 8 * i;
+        bytes[i] = static_cast<uchar>(value >> shift);
+    }
+    return std::make_shared<const XorKey>(bytes);
+}
+
+XorKey::XorKey(const std::array<uchar, keySize>& bytes) : keyValue(0) {
+    for (int i = 0; i < keySize; ++i) {
+        keyValue = (keyValue << 8) | bytes[i];
+    }
+    for (int phase = 0; phase < keySize; ++phase) {
+        for (int i = 0; i < laneSize; ++i) {
+            lanes[phase][i] = bytes[(phase + i) % keySize];
+        }
+    }
+}
+
+void XorKey::apply(char* data, qint64 size, quint64 offset) const {
+    applyLane(data, size, lane(static_cast<int>(offset % keySize)));
+}
+
+void XorKey::applyLane(char* data, qint64 size, const uchar* pattern) {
+    const int wordsInLane = laneSize / sizeof(quint64);
+    quint64 words[wordsInLane];
+    std::memcpy(words, pattern, laneSize);
+
+    qint64 i = 0;
+    // Word-wise loop over whole lanes, the compiler turns it into vector instructions
+    for (; i + laneSize <= size; i += laneSize) {
+        quint64 chunk[wordsInLane];
+        std::memcpy(chunk, data + i, laneSize);
+        for (int w = 0; w < wordsInLane; ++w) {
+            chunk[w] ^= words[w];
+        }
+        std::memcpy(data + i, chunk, laneSize);
+    }
+    for (; i < size; ++i) {
+        data[i] = static_cast<char>(data[i] ^ pattern[i % laneSize]);
+    }
+}
+
+}
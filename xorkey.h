@@ -0,0 +1,98 @@
+/**
+ * @file xorkey.h
+ * @brief Parsed 8-byte XOR key shared read-only between all tasks
+ */
+#ifndef XORKEY_H
+#define XORKEY_H
+
+#include <QString>
+#include <QtGlobal>
+#include <array>
+#include <memory>
+
+/**
+ * @namespace nXorKey
+ * @brief Contains class XorKey, enum ByteOrder and struct KeyFormat
+ */
+namespace nXorKey {
+
+/**
+ * @enum ByteOrder
+ * @brief Specifies in which order the bytes of the HEX value are applied to the file
+ */
+enum class ByteOrder {
+    BigEndian,
+    LittleEndian
+};
+
+/**
+ * @struct KeyFormat
+ * @brief Describes how the key entered by the user must be interpreted
+ */
+struct KeyFormat {
+    ByteOrder order = ByteOrder::BigEndian;
+    /**
+     * @brief legacy Use the first 8 characters of the key string ("0x123456") instead of the bytes of the HEX value.
+     * Needed to restore files written by older versions of the program
+     */
+    bool legacy = false;
+};
+
+/**
+ * @class XorKey
+ * @brief Immutable key. The key is parsed once, after which the lanes for all 8 phase offsets are precomputed,
+ * so the hot loop only works with raw bytes
+ */
+class XorKey {
+public:
+    static const int keySize = 8;
+    /**
+     * @brief laneSize Size of one precomputed lane. Its first 8/16/32 bytes are the narrower lanes
+     */
+    static const int laneSize = 64;
+
+    /**
+     * @brief fromString Parses the key entered by the user
+     * @param key Key is 8 bytes in HEX format. It must begin with the following format: 0x
+     * @param format How the key should be interpreted
+     * @return Parsed key or nullptr if the key is incorrect
+     */
+    static std::shared_ptr<const XorKey> fromString(const QString& key, const KeyFormat& format = KeyFormat());
+    /**
+     * @brief XorKey Constructor
+     * @param bytes The bytes in the order in which they are applied to the file
+     */
+    explicit XorKey(const std::array<uchar, keySize>& bytes);
+
+    /**
+     * @brief value Key value, the first byte of the file is XORed with the most significant byte
+     */
+    quint64 value() const { return keyValue; }
+    /**
+     * @brief lane Returns laneSize bytes of the key starting from the specified phase
+     * @param phase Offset in the key (0..7)
+     */
+    const uchar* lane(int phase) const { return lanes[phase & (keySize - 1)].data(); }
+    /**
+     * @brief apply Performs XOR on a piece of the file
+     * @param data Data to be modified in place
+     * @param size Size of data in bytes
+     * @param offset Absolute offset of the data in the file, determines the phase of the key
+     */
+    void apply(char* data, qint64 size, quint64 offset) const;
+    /**
+     * @brief applyLane Performs XOR of data with a repeating lane
+     * @param data Data to be modified in place
+     * @param size Size of data in bytes
+     * @param lane laneSize bytes of the pattern, the first byte is applied to data[0]
+     */
+    static void applyLane(char* data, qint64 size, const uchar* lane);
+
+private:
+    quint64 keyValue;
+    alignas(laneSize) std::array<std::array<uchar, laneSize>, keySize> lanes;
+};
+
+}
+
+#endif // XORKEY_H